@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+// Emulated time is counted in ticks of the 14.31818 MHz master crystal, which is exactly 315/22 MHz.
+// Every other clock in the machine is an integer division of it, so they all stay in step
+#define MASTER_CLOCK_NUMERATOR 315000000
+#define MASTER_CLOCK_DENOMINATOR 22
+
+// 4.77272 MHz
+#define CPU_CLOCK_DIVIDER 3
+
+// 1.19318 MHz
+#define PIT_CLOCK_DIVIDER 12
+
+namespace Cepums {
+
+    // Converts a host timer reading into master clock ticks without losing precision over long runs
+    inline uint64_t hostToMasterTicks(uint64_t hostTicks, uint64_t hostFrequency)
+    {
+        uint64_t seconds = hostTicks / hostFrequency;
+        uint64_t remainder = hostTicks % hostFrequency;
+        return (seconds * MASTER_CLOCK_NUMERATOR + remainder * MASTER_CLOCK_NUMERATOR / hostFrequency) / MASTER_CLOCK_DENOMINATOR;
+    }
+
+    // And the other way around
+    inline uint64_t masterTicksToHost(uint64_t ticks, uint64_t hostFrequency)
+    {
+        uint64_t seconds = ticks * MASTER_CLOCK_DENOMINATOR / MASTER_CLOCK_NUMERATOR;
+        uint64_t remainder = ticks * MASTER_CLOCK_DENOMINATOR % MASTER_CLOCK_NUMERATOR;
+        return seconds * hostFrequency + remainder * hostFrequency / MASTER_CLOCK_NUMERATOR;
+    }
+
+    inline uint64_t microsecondsToMasterTicks(uint64_t microseconds)
+    {
+        return microseconds * MASTER_CLOCK_NUMERATOR / MASTER_CLOCK_DENOMINATOR / 1000000;
+    }
+
+    // Only meant for reporting
+    inline double masterTicksToSeconds(uint64_t ticks)
+    {
+        return (double)ticks * MASTER_CLOCK_DENOMINATOR / MASTER_CLOCK_NUMERATOR;
+    }
+}
@@ -24,7 +24,7 @@
 #define INSTRUCTION_TRACE(...) if(s_debugSpam) DC_CORE_WARN(__VA_ARGS__)
 //#define INSTRUCTION_TRACE(...)
 
-#define BIT(x) (1 << x)
+#define BIT(x) (1 << (x))
 #define IS_BIT_SET(number, bit) ((number >> bit) & 1U)
 #define IS_BIT_NOT_SET(number, bit) !(IS_BIT_SET(number, bit))
 #define DO_PARITY_BYTE(byte) byte ^= byte >> 4; byte ^= byte >> 2; byte ^= byte >> 1
@@ -0,0 +1,255 @@
+#include "cepumspch.h"
+#include "DMAController.h"
+
+// Command register
+#define COMMAND_CONTROLLER_DISABLE 2
+
+// Request and single mask registers
+#define REQUEST_SET 2
+#define MASK_SET 2
+
+namespace Cepums {
+
+    DMAController::DMAController(MemoryManager& memoryManager)
+        : m_memoryManager(memoryManager)
+    {
+    }
+
+    uint8_t DMAController::readPort(uint16_t port)
+    {
+        // Address and count registers, low byte first
+        if (port < 0x08)
+        {
+            auto& channel = m_channels[port >> 1];
+            uint16_t value = (port & 1) ? channel.currentCount : channel.currentAddress;
+            bool high = m_flipFlop;
+            m_flipFlop = !m_flipFlop;
+            return high ? value >> 8 : value & 0xFF;
+        }
+
+        switch (port)
+        {
+        case 0x08: // Status register, reading it clears the terminal count bits
+        {
+            uint8_t status = m_status;
+            m_status &= 0xF0;
+            return status;
+        }
+        case 0x0D: // Temporary register
+            return m_temporary;
+
+        // Page registers
+        case 0x87:
+            return m_channels[0].page;
+        case 0x83:
+            return m_channels[1].page;
+        case 0x81:
+            return m_channels[2].page;
+        case 0x82:
+            return m_channels[3].page;
+
+        default:
+            return IODevice::readPort(port);
+        }
+    }
+
+    void DMAController::writePort(uint16_t port, uint8_t value)
+    {
+        // Address and count registers, low byte first. Writes go to both the base and the current register
+        if (port < 0x08)
+        {
+            auto& channel = m_channels[port >> 1];
+            uint16_t& base = (port & 1) ? channel.baseCount : channel.baseAddress;
+            if (m_flipFlop)
+                base = (base & 0x00FF) | (uint16_t)value << 8;
+            else
+                base = (base & 0xFF00) | value;
+            m_flipFlop = !m_flipFlop;
+
+            if (port & 1)
+                channel.currentCount = base;
+            else
+                channel.currentAddress = base;
+            return;
+        }
+
+        switch (port)
+        {
+        case 0x08: // Command register
+            if (IS_BIT_SET(value, COMMAND_CONTROLLER_DISABLE))
+                DC_CORE_TRACE("[DMA]: Controller disabled");
+            m_command = value;
+            return;
+
+        case 0x09: // Request register
+            if (IS_BIT_SET(value, REQUEST_SET))
+                m_status |= BIT((value & 0x3) + 4);
+            else
+                m_status &= ~BIT((value & 0x3) + 4);
+            return;
+
+        case 0x0A: // Single channel mask register
+            m_channels[value & 0x3].masked = IS_BIT_SET(value, MASK_SET);
+            return;
+
+        case 0x0B: // Mode register
+        {
+            auto& channel = m_channels[value & 0x3];
+            channel.mode = value;
+            if (channel.getTransferType() == DMATransferType::Invalid)
+                DC_CORE_WARN("[DMA]: Invalid transfer type 0b11 on channel {0}", value & 0x3);
+            return;
+        }
+
+        case 0x0C: // Clear byte pointer flip-flop
+            m_flipFlop = false;
+            return;
+
+        case 0x0D: // Master clear
+            return masterClear();
+
+        case 0x0E: // Clear mask register
+            for (auto& channel : m_channels)
+                channel.masked = false;
+            return;
+
+        case 0x0F: // Write all mask register bits
+            for (auto i = 0; i < DMA_CHANNEL_COUNT; i++)
+                m_channels[i].masked = IS_BIT_SET(value, i);
+            return;
+
+        // Page registers
+        case 0x87:
+            m_channels[0].page = value;
+            return;
+        case 0x83:
+            m_channels[1].page = value;
+            return;
+        case 0x81:
+            m_channels[2].page = value;
+            return;
+        case 0x82:
+            m_channels[3].page = value;
+            return;
+
+        default:
+            return IODevice::writePort(port, value);
+        }
+    }
+
+    void DMAController::serialize(std::ostream& stream) const
+    {
+        for (auto& channel : m_channels)
+            writeState(stream, channel);
+        writeState(stream, m_command);
+        writeState(stream, m_status);
+        writeState(stream, m_temporary);
+        writeState(stream, m_flipFlop);
+    }
+
+    void DMAController::restore(std::istream& stream)
+    {
+        for (auto& channel : m_channels)
+            readState(stream, channel);
+        readState(stream, m_command);
+        readState(stream, m_status);
+        readState(stream, m_temporary);
+        readState(stream, m_flipFlop);
+    }
+
+    DMATransfer DMAController::writeToMemory(uint8_t channel, const uint8_t* data, size_t length)
+    {
+        // Write transfers never touch the buffer
+        return transfer(channel, const_cast<uint8_t*>(data), length, DMATransferType::Write);
+    }
+
+    DMATransfer DMAController::readFromMemory(uint8_t channel, uint8_t* data, size_t length)
+    {
+        return transfer(channel, data, length, DMATransferType::Read);
+    }
+
+    DMATransfer DMAController::transfer(uint8_t channel, uint8_t* data, size_t length, DMATransferType type)
+    {
+        DMATransfer result;
+        auto& state = m_channels[channel];
+        if (state.masked || IS_BIT_SET(m_command, COMMAND_CONTROLLER_DISABLE))
+            return result;
+
+        // Verify transfers go through the motions without touching memory
+        DMATransferType channelType = state.getTransferType();
+        if (channelType != type && channelType != DMATransferType::Verify)
+        {
+            DC_CORE_WARN("[DMA]: Channel {0} isn't set up for this transfer direction", channel);
+            return result;
+        }
+
+        size_t& done = result.length;
+        while (done < length)
+        {
+            // The count register holds one less than the bytes left
+            size_t remaining = (size_t)state.currentCount + 1;
+            size_t run = std::min(length - done, remaining);
+            uint32_t physical = (uint32_t)state.page << 16 | state.currentAddress;
+
+            if (state.isDecrementing())
+            {
+                // Nothing common uses this, so it isn't worth a bulk path
+                run = 1;
+                if (channelType == DMATransferType::Write)
+                    m_memoryManager.writeBlock(physical, data + done, 1);
+                else if (channelType == DMATransferType::Read)
+                    m_memoryManager.readBlock(physical, data + done, 1);
+                state.currentAddress--;
+            }
+            else
+            {
+                // The address wraps around inside its 64K page, the page register doesn't count
+                run = std::min(run, (size_t)0x10000 - state.currentAddress);
+                if (channelType == DMATransferType::Write)
+                    m_memoryManager.writeBlock(physical, data + done, run);
+                else if (channelType == DMATransferType::Read)
+                    m_memoryManager.readBlock(physical, data + done, run);
+                state.currentAddress += (uint16_t)run;
+            }
+
+            state.currentCount -= (uint16_t)run;
+            done += run;
+
+            if (run == remaining)
+            {
+                terminalCount(channel);
+                result.terminalCount = true;
+                break;
+            }
+        }
+        return result;
+    }
+
+    void DMAController::terminalCount(uint8_t channel)
+    {
+        auto& state = m_channels[channel];
+        SET_BIT(m_status, channel);
+        m_status &= ~BIT(channel + 4);
+
+        // Auto-initialize starts over, otherwise the channel masks itself
+        if (state.isAutoInitialize())
+        {
+            state.currentAddress = state.baseAddress;
+            state.currentCount = state.baseCount;
+        }
+        else
+        {
+            state.masked = true;
+        }
+    }
+
+    void DMAController::masterClear()
+    {
+        for (auto& channel : m_channels)
+            channel.masked = true;
+        m_command = 0;
+        m_status = 0;
+        m_temporary = 0;
+        m_flipFlop = false;
+    }
+}
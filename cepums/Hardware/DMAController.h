@@ -0,0 +1,80 @@
+#pragma once
+
+#include "IODevice.h"
+#include "MemoryManager.h"
+
+#define DMA_CHANNEL_COUNT 4
+
+// DMA channels on the XT
+#define DMA_CHANNEL_REFRESH 0
+#define DMA_CHANNEL_FLOPPY 2
+#define DMA_CHANNEL_HARD_DISK 3
+
+namespace Cepums {
+
+    enum class DMATransferType
+    {
+        Verify,
+        Write, // Device to memory
+        Read, // Memory to device
+        Invalid
+    };
+
+    // What a device side transfer did
+    struct DMATransfer
+    {
+        size_t length = 0;
+        bool terminalCount = false; // The channel ran out, the device should end its operation
+    };
+
+    struct DMAChannel
+    {
+        uint16_t baseAddress = 0;
+        uint16_t baseCount = 0;
+        uint16_t currentAddress = 0;
+        uint16_t currentCount = 0;
+        uint8_t page = 0;
+        uint8_t mode = 0;
+        bool masked = true;
+
+        DMATransferType getTransferType() const { return (DMATransferType)((mode >> 2) & 0x3); }
+        bool isAutoInitialize() const { return (mode >> 4) & 1U; }
+        bool isDecrementing() const { return (mode >> 5) & 1U; }
+    };
+
+    // Intel 8237A DMA controller and the page registers that extend its addresses to 20 bits.
+    // There are no bus cycles: a device with data ready asks for a transfer and the whole run is copied at once
+    class DMAController : public IODevice
+    {
+    public:
+        DMAController(MemoryManager& memoryManager);
+
+        const char* getName() const override { return "DMA"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x00, 0x0F }, { 0x81, 0x83 }, { 0x87, 0x87 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        void serialize(std::ostream& stream) const override;
+        void restore(std::istream& stream) override;
+
+        // Device side. Each moves up to length bytes and reports how many it moved, which is less once the
+        // channel reaches terminal count. Nothing moves while the channel is masked or set up the other way
+        DMATransfer writeToMemory(uint8_t channel, const uint8_t* data, size_t length);
+        DMATransfer readFromMemory(uint8_t channel, uint8_t* data, size_t length);
+
+        // Bytes the channel will move before terminal count, 0 while it's masked
+        size_t getRemainingCount(uint8_t channel) const { return m_channels[channel].masked ? 0 : (size_t)m_channels[channel].currentCount + 1; }
+    private:
+        DMATransfer transfer(uint8_t channel, uint8_t* data, size_t length, DMATransferType type);
+        void terminalCount(uint8_t channel);
+        void masterClear();
+    private:
+        MemoryManager& m_memoryManager;
+
+        DMAChannel m_channels[DMA_CHANNEL_COUNT];
+        uint8_t m_command = 0;
+        uint8_t m_status = 0; // Bits 0-3 terminal count, 4-7 requests
+        uint8_t m_temporary = 0;
+        bool m_flipFlop = false; // Set when the next byte is the high one
+    };
+}
@@ -3,7 +3,51 @@
 
 namespace Cepums {
 
-	void FakeFDC::execute(MemoryManager& mm)
+	FakeFDC::FakeFDC(DiskBackend& disk, MemoryManager& memoryManager)
+		: m_disk(disk)
+		, m_memoryManager(memoryManager)
+	{
+	}
+
+	void FakeFDC::writePort(uint16_t port, uint8_t value)
+	{
+		switch (port)
+		{
+		case 0xE0:
+			return setSectorCount(value);
+		case 0xE1:
+			return setCommand(value);
+		case 0xE6:
+			return setStartCylinder(value);
+		case 0xE7:
+			return setStartSector(value);
+		case 0xE8:
+			return setHead(value);
+		default:
+			return IODevice::writePort(port, value);
+		}
+	}
+
+	void FakeFDC::writePortWord(uint16_t port, uint16_t value)
+	{
+		switch (port)
+		{
+		case 0xE2:
+			return setUpperAddress(value);
+		case 0xE4:
+			return setLowerAddress(value);
+		default:
+			return IODevice::writePortWord(port, value);
+		}
+	}
+
+	void FakeFDC::runEvent(uint64_t time)
+	{
+		m_commandPending = false;
+		execute();
+	}
+
+	void FakeFDC::execute()
 	{
 		switch (m_command)
 		{
@@ -20,44 +64,46 @@ namespace Cepums {
 			break;
 		}
 
-		DC_CORE_TRACE("[FakeFDC] Reading {0} sectors from {1:X}:{2:X} to {3:X}::{4:X}", m_sectorCount, m_startCylinder, m_startSector, m_upperAddress, m_lowerAddress);
-		DC_CORE_ASSERT(m_startCylinder < 80, "There are 80 cylinders");
-		DC_CORE_ASSERT(m_startSector < 18, "There are 18 sectors per cylinder")
-
-		if (m_disk1.empty()) {
-			DC_CORE_TRACE("[FakeFDC] Loading disk 1 ...");
-			m_disk1.resize(1440 * 1024); // 1.44 MB
-
-			std::ifstream diskBinary;
+		DC_CORE_TRACE("[FakeFDC] Reading {0} sectors from {1:X}:{2:X}:{3:X} to {4:X}::{5:X}", m_sectorCount, m_startCylinder, m_head, m_startSector + 1, m_upperAddress, m_lowerAddress);
 
-			auto disk1 = "Disk1.img";
-
-			diskBinary.open(disk1, std::ios::binary);
-			if (diskBinary.is_open())
-			{
-				diskBinary.read((char*)m_disk1.data(), 1440 * 1024);
-				diskBinary.close();
-			}
-			else {
-				DC_CORE_ERROR("[FakeFDC] Disk1.img not present !!!");
-				VERIFY_NOT_REACHED();
-			}
+		if (!m_disk.isOpen())
+		{
+			DC_CORE_ERROR("[FakeFDC] No disk image to read from");
+			m_command = 0;
+			return;
 		}
 
-		uint16_t lowerAddressCounting = m_lowerAddress;
+		// The run continues on the next head and cylinder in the image's own order
+		size_t lba = m_disk.toLBA(m_startCylinder, m_head, m_startSector + 1);
+		if (lba == INVALID_LBA)
+		{
+			DC_CORE_ERROR("[FakeFDC] Sector {0:X}:{1:X}:{2:X} is outside of the disk", m_startCylinder, m_head, m_startSector + 1);
+			m_command = 0;
+			return;
+		}
 
-		for (auto i = 0; i < m_sectorCount; i++)
+		// The offset wraps around inside the segment, so runs are split there
+		auto copyToGuest = [this](size_t position, const uint8_t* data, size_t length)
 		{
-			auto headOffset = m_head * 80 * 18 * 512;
-			auto cylinderOffset = m_startCylinder * 18 * 512;
-			auto sectorOffset = (m_startSector + i) * 512;
-			for (size_t j = 0; j < 512; j++)
+			while (length > 0)
 			{
-				auto value = m_disk1[headOffset + cylinderOffset + sectorOffset + j];
-				mm.writeByte(m_upperAddress, lowerAddressCounting, value);
-				lowerAddressCounting++;
+				uint16_t offset = (uint16_t)(m_lowerAddress + position);
+				size_t part = std::min(length, (size_t)0x10000 - offset);
+				m_memoryManager.writeBlock(((uint32_t)m_upperAddress << 4) + offset, data, part);
+				position += part;
+				data += part;
+				length -= part;
 			}
+		};
+
+		// Sector by sector, since written ones live apart from the image. Whatever the image is missing reads as zeroes
+		static const uint8_t zeroes[SECTOR_SIZE] = {};
+		for (size_t i = 0; i < m_sectorCount; i++)
+		{
+			const uint8_t* sector = m_disk.getSector(lba + i);
+			copyToGuest(i * SECTOR_SIZE, sector ? sector : zeroes, SECTOR_SIZE);
 		}
+
 		m_command = 0;
 	}
 }
@@ -1,15 +1,30 @@
 #pragma once
 
+#include "IODevice.h"
 #include "MemoryManager.h"
+#include "Storage/DiskBackend.h"
 
 namespace Cepums {
 
-    class FakeFDC
+    // DUCKMACHINE's made up disk controller: the BIOS hands it a whole transfer through a few ports
+    class FakeFDC : public IODevice
     {
     public:
-        void execute(MemoryManager& mm);
+        FakeFDC(DiskBackend& disk, MemoryManager& memoryManager);
 
-        void setCommand(uint8_t command) { m_command = command; }
+        const char* getName() const override { return "FakeFDC"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0xE0, 0xE1 }, { 0xE6, 0xE8 } }; }
+        void writePort(uint16_t port, uint8_t value) override;
+
+        // The transfer address goes in as two words
+        std::vector<PortRange> getWordPortRanges() const override { return { { 0xE2, 0xE2 }, { 0xE4, 0xE4 } }; }
+        void writePortWord(uint16_t port, uint16_t value) override;
+
+        // Commands run right after they're written
+        uint64_t getNextEventTime(uint64_t now) override { return m_commandPending ? now : NO_EVENT; }
+        void runEvent(uint64_t time) override;
+
+        void setCommand(uint8_t command) { m_command = command; m_commandPending = true; }
         void setSectorCount(uint8_t sectorCount) { m_sectorCount = sectorCount; }
 
         void setUpperAddress(uint16_t address) { m_upperAddress = address; }
@@ -19,7 +34,13 @@ namespace Cepums {
         void setStartSector(uint8_t sector) { m_startSector = sector - 1; }
         void setHead(uint8_t head) { m_head = head; }
     private:
+        void execute();
+    private:
+        DiskBackend& m_disk;
+        MemoryManager& m_memoryManager;
+
         uint8_t m_command = 0;
+        bool m_commandPending = false;
         uint8_t m_sectorCount = 0;
 
         uint16_t m_upperAddress = 0;
@@ -28,7 +49,5 @@ namespace Cepums {
         uint8_t m_startCylinder = 0;
         uint8_t m_startSector = 0;
         uint8_t m_head = 0;
-
-        std::vector<uint8_t> m_disk1;
     };
 }
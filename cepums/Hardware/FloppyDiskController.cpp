@@ -1,30 +1,216 @@
 #include "cepumspch.h"
 #include "FloppyDiskController.h"
 
+#include <cstring>
+
 #define DRIVE_3 3
 #define DRIVE_2 2
 #define DRIVE_1 1
 #define DRIVE_0 0
 
+// The execution phase starts at least this many CPU clocks after the last command byte
+#define FLOPPY_INSTANT_DELAY 100
+
+// Realistic timing: 300 RPM drives that take 15 ms to settle after a seek
+#define FLOPPY_RPM 300
+#define FLOPPY_HEAD_SETTLE_TIME 15000
+
+// Status register 0
+#define ST0_ABNORMAL_TERMINATION 0x40
+#define ST0_INVALID_COMMAND 0x80
+#define ST0_READY_CHANGED 0xC0
+#define ST0_SEEK_END 0x20
+
+// Status register 1
+#define ST1_MISSING_ADDRESS_MARK 0x01
+#define ST1_NO_DATA 0x04
+#define ST1_OVERRUN 0x10
+#define ST1_END_OF_CYLINDER 0x80
+
+// Status register 2
+#define ST2_WRONG_CYLINDER 0x10
+
+// Sector size code for 512 bytes, the only one plain images can hold
+#define SECTOR_SIZE_CODE 2
+
 namespace Cepums {
 
+    // Command and parameter bytes, 0 for invalid commands
+    static size_t getCommandLength(uint8_t command)
+    {
+        switch ((FDCCommand)(command & 0x1F))
+        {
+        case FDCCommand::SenseInterruptStatus:
+        case FDCCommand::Version:
+            return 1;
+        case FDCCommand::SenseDriveStatus:
+        case FDCCommand::Recalibrate:
+        case FDCCommand::ReadID:
+            return 2;
+        case FDCCommand::Specify:
+        case FDCCommand::Seek:
+            return 3;
+        case FDCCommand::FormatTrack:
+            return 6;
+        case FDCCommand::ReadTrack:
+        case FDCCommand::WriteData:
+        case FDCCommand::ReadData:
+        case FDCCommand::WriteDeletedData:
+        case FDCCommand::ReadDeletedData:
+            return 9;
+        default:
+            return 0;
+        }
+    }
+
+    // SPECIFY's times are in units for 500 kbps and stretch at the slower rates
+    static const unsigned int s_dataRates[] = { 500, 300, 250, 1000 };
+
+    FloppyDiskController::FloppyDiskController(DMAController& DMA, DiskTiming timing)
+        : m_DMA(DMA)
+        , m_timing(timing)
+    {
+    }
+
+    void FloppyDiskController::insertDisk(uint8_t drive, DiskBackend* disk)
+    {
+        m_drives[drive].disk = disk;
+        m_drives[drive].trackCache.clear();
+    }
+
+    bool FloppyDiskController::getGeometryForSize(size_t size, DiskGeometry& geometry)
+    {
+        static const DiskGeometry s_formats[] = {
+            { 40, 1, 8 }, // 160K
+            { 40, 1, 9 }, // 180K
+            { 40, 2, 8 }, // 320K
+            { 40, 2, 9 }, // 360K
+            { 80, 2, 9 }, // 720K
+            { 80, 2, 15 }, // 1.2M
+            { 80, 2, 18 }, // 1.44M
+            { 80, 2, 36 }, // 2.88M
+        };
+
+        for (auto& format : s_formats)
+        {
+            if (format.getSize() == size)
+            {
+                geometry = format;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint8_t FloppyDiskController::getCMOSDriveType(const DiskGeometry& geometry)
+    {
+        // 5.25" double density disks of every size go in a 360K drive
+        if (geometry.cylinders == 40)
+            return 1;
+        switch (geometry.sectorsPerTrack)
+        {
+        case 9:
+            return 3; // 720K
+        case 15:
+            return 2; // 1.2M
+        case 18:
+            return 4; // 1.44M
+        case 36:
+            return 5; // 2.88M
+        default:
+            return 0;
+        }
+    }
+
+    uint8_t FloppyDiskController::readPort(uint16_t port)
+    {
+        switch (port)
+        {
+        case 0x3F0:
+            return readStatusRegisterA();
+        case 0x3F1:
+            return readStatusRegisterB();
+        case 0x3F4:
+            return readMainStatusRegister();
+        case 0x3F5:
+            return readDataFIFO();
+        case 0x3F7:
+            return readDigitalInputRegister();
+        default:
+            return IODevice::readPort(port);
+        }
+    }
+
+    void FloppyDiskController::writePort(uint16_t port, uint8_t value)
+    {
+        switch (port)
+        {
+        case 0x3F2:
+            return writeDigitalOutputRegister(value);
+        case 0x3F5:
+            return writeDataFIFO(value);
+        case 0x3F7:
+            return writeConfigurationControlRegister(value);
+        default:
+            return IODevice::writePort(port, value);
+        }
+    }
+
+    uint64_t FloppyDiskController::getNextEventTime(uint64_t now)
+    {
+        if (m_eventRequested)
+        {
+            m_eventRequested = false;
+            m_eventTime = now + getExecutionDelay(now);
+        }
+        return m_eventTime;
+    }
+
+    void FloppyDiskController::runEvent(uint64_t time)
+    {
+        m_eventTime = NO_EVENT;
+
+        if (m_phase == FDCPhase::Execution)
+            return executeCommand();
+
+        // Coming out of reset
+        if (isIRQEnabled())
+            pulseIRQ();
+    }
+
     uint8_t FloppyDiskController::readStatusRegisterA()
     {
-        TODO();
-        return uint8_t();
+        // PS/2 only, the selected drive's lines. Most of them are active low
+        auto& drive = m_drives[m_DOR & 0x3];
+        uint8_t status = 0x06; // No index pulse, not write protected
+        if (!m_drives[DRIVE_1].disk)
+            SET_BIT(status, 6);
+        if (drive.cylinder != 0)
+            SET_BIT(status, 4);
+        if (m_phase == FDCPhase::Result || !m_interruptStatus.empty())
+            SET_BIT(status, 7);
+        return status;
     }
 
     uint8_t FloppyDiskController::readStatusRegisterB()
     {
-        TODO();
-        return uint8_t();
+        // PS/2 only. Bits 7 and 6 always read as set
+        uint8_t status = 0xC0;
+        if (IS_BIT_SET(m_DOR, 0))
+            SET_BIT(status, 5);
+        if (m_drives[DRIVE_1].motorActive)
+            SET_BIT(status, 1);
+        if (m_drives[DRIVE_0].motorActive)
+            SET_BIT(status, 0);
+        return status;
     }
 
     void FloppyDiskController::writeDigitalOutputRegister(uint8_t value)
     {
-        DC_CORE_INFO("[FDC]: Writing '0x{0:X}' to DOR", value);
+        DC_CORE_TRACE("[FDC]: Writing '0x{0:X}' to DOR", value);
 
-        // If RESET, we can skip ignore the rest
+        bool wasInReset = IS_BIT_NOT_SET(m_DOR, 2);
+        m_DOR = value;
 
         // Drive motors (bits 7-4)
         updateDriveMotor(IS_BIT_SET(value, 7), DRIVE_3);
@@ -32,26 +218,18 @@ namespace Cepums {
         updateDriveMotor(IS_BIT_SET(value, 5), DRIVE_1);
         updateDriveMotor(IS_BIT_SET(value, 4), DRIVE_0);
 
-        // Bit 3 - IRQ - is handled by the IOManager
-        if (IS_BIT_SET(value, 3))
-            m_IRQenabled = true;
-        else
-            m_IRQenabled = false;
-
-        // Bit 2 not being set means reset mode
+        // Bit 2 not being set holds the controller in reset.
+        // Bit 3 gates the interrupt and DMA request lines, bits 0 and 1 select the drive
         if (IS_BIT_NOT_SET(value, 2))
-        {
-            DC_CORE_ERROR("[FDC]: Command to reset received");
-            // I don't know exactly what to do in this situation
-            m_direction = TransferDirection::FromSystemToController;
-            m_outputBuffer.clear();
-        }
+            return reset();
 
-        // Bits 0 and 1 select the drive for next access
-        if (IS_BIT_SET(value, 1) || IS_BIT_SET(value, 0))
+        // Coming out of reset the controller polls the drives and reports all four as having changed ready state
+        if (wasInReset)
         {
-            DC_CORE_TRACE("[FDC]: Drive select TODO");
-            TODO();
+            DC_CORE_TRACE("[FDC]: Leaving reset");
+            for (uint8_t drive = 0; drive < FLOPPY_DRIVE_COUNT; drive++)
+                m_interruptStatus.push_back({ ST0_READY_CHANGED | drive, m_drives[drive].cylinder });
+            m_eventRequested = true;
         }
     }
 
@@ -69,232 +247,490 @@ namespace Cepums {
         bit 1 = 1  drive 1 busy(= drive is in seek mode)
         bit 0 = 1  drive 0 busy(= drive is in seek mode)
         */
-        uint8_t byte = 0x80; // bit 7 is set
-        DC_CORE_TRACE("[FDC]: Read main status register");
+        uint8_t byte = m_seekingDrives;
 
-        // Set direction bit
-        if (m_direction == TransferDirection::FromControllerToSystem)
+        switch (m_phase)
         {
+        case FDCPhase::Command:
+            SET_BIT(byte, 7);
+            if (!m_command.empty())
+                SET_BIT(byte, 4);
+            break;
+        case FDCPhase::Execution:
+            SET_BIT(byte, 4);
+            break;
+        case FDCPhase::Result:
+            SET_BIT(byte, 7);
             SET_BIT(byte, 6);
+            SET_BIT(byte, 4);
+            break;
         }
 
-        // IRQ enabled
-        if (!m_IRQenabled)
+        return byte;
+    }
+
+    uint8_t FloppyDiskController::readDataFIFO()
+    {
+        if (m_phase != FDCPhase::Result)
         {
-            SET_BIT(byte, 5);
+            DC_CORE_WARN("[FDC]: Reading data FIFO outside of the result phase");
+            return 0xFF;
         }
 
+        uint8_t byte = m_result.front();
+        m_result.pop_front();
+        DC_CORE_TRACE("[FDC]: Read data FIFO: '0x{0:X}'", byte);
 
-        if (m_outputBuffer.size() > 0)
-        {
-            SET_BIT(byte, 4);
-            m_busy = false;
-        }
+        if (m_result.empty())
+            m_phase = FDCPhase::Command;
 
         return byte;
     }
 
-    uint8_t FloppyDiskController::readDataFIFO()
+    void FloppyDiskController::writeDataFIFO(uint8_t data)
     {
-        if (m_outputBuffer.size() > 0)
+        if (m_phase != FDCPhase::Command)
         {
-            std::string mode;
-            switch (m_FDCmode)
+            DC_CORE_WARN("[FDC]: Ignoring data FIFO write of 0x{0:X} while a command is running", data);
+            return;
+        }
+
+        if (m_command.empty())
+        {
+            m_commandLength = getCommandLength(data);
+            if (m_commandLength == 0)
             {
-            case FDCMode::Nothing:
-                DC_CORE_ERROR("[FDC]: Reading FIFO in WAITING mode");
-                mode = "WAITING";
-                break;
-            case FDCMode::Recalibrate:
-                mode = "Recalibrate";
-                break;
-            case FDCMode::SenseInterruptStatus:
-                mode = "SenseInterruptStatus";
-                break;
-            case FDCMode::ReadID:
-                mode = "ReadID";
-                break;
-            default:
-                TODO();
-                break;
+                DC_CORE_WARN("[FDC]: Invalid command 0x{0:X}", data);
+                return finishCommand({ ST0_INVALID_COMMAND }, false);
             }
+        }
 
-            uint8_t byte = m_outputBuffer.back();
-            DC_CORE_TRACE("[FDC]: Read data FIFO in {1} mode: '0x{0:x}'", byte, mode);
-            m_outputBuffer.pop_back();
+        m_command.push_back(data);
+        if (m_command.size() == m_commandLength)
+            startCommand();
+    }
 
-            // Clear our mode if the buffer is empty
-            if (m_outputBuffer.size() == 0)
-            {
-                m_direction = TransferDirection::FromSystemToController;
-                m_FDCmode = FDCMode::Nothing;
-            }
+    uint8_t FloppyDiskController::readDigitalInputRegister()
+    {
+        DC_CORE_TRACE("[FDC]: Read digital input register");
 
-            return byte;
-        }
-        DC_CORE_ERROR("[FDC]: Attempt to read data FIFO register but buffer is empty!");
 
-        TODO();
-        return 0;
+        //return 0x81; // bit 7 and bit 0 set - diskette change and high-density select
+        return 1;
     }
 
-    void FloppyDiskController::writeDataFIFO(uint8_t data)
+    void FloppyDiskController::writeConfigurationControlRegister(uint8_t value)
     {
-        // We're in a command, so we're probably waiting for more command bytes
-        switch (m_FDCmode)
-        {
-        // Are we expecting a new command?
-        case FDCMode::Nothing:
+        // Bits 0 and 1 specify the speed. Images don't care about it
+        DC_CORE_TRACE("[FDC]: Writing configuration control register: data rate {0}", value & 0x3);
+        m_dataRate = value & 0x3;
+    }
+
+    void FloppyDiskController::reset()
+    {
+        DC_CORE_TRACE("[FDC]: Reset");
+
+        m_phase = FDCPhase::Command;
+        m_command.clear();
+        m_result.clear();
+        m_interruptStatus.clear();
+        m_seekingDrives = 0;
+        m_eventRequested = false;
+        m_eventTime = NO_EVENT;
+    }
+
+    void FloppyDiskController::updateDriveMotor(uint8_t boolean, unsigned int drivenum)
+    {
+        if (boolean)
         {
-            switch (data)
+            if (!m_drives[drivenum].motorActive)
             {
-            case 0x03: // FDC Specify Step & Head Load
-                DC_CORE_INFO("[FDC]: Sense command received");
-                m_FDCmode = FDCMode::Specify;
-                m_lastCommandByteWritten = 0; // We need more bytes
-                return;
-
-            case 0x07: // FDC Recalibrate
-                DC_CORE_INFO("[FDC]: Recalibrate command received");
-                // We still need to receive one more command byte
-                m_FDCmode = FDCMode::Recalibrate;
-                m_lastCommandByteWritten = 0; // We need more bytes
-                return;
-
-            case 0x08: // FDC Sense Interrupt Status
-                DC_CORE_INFO("[FDC]: Sense Interrupt Status command received");
-                // Result 1: Present cylinder number
-                m_outputBuffer.push_back(80); // TODO: This needs to come from a mounted disk image
-                // Result 0: Status register 0
-                m_outputBuffer.push_back(m_statusRegister0);
-
-                // We are ready to send data back
-                m_direction = TransferDirection::FromControllerToSystem;
-                m_FDCmode = FDCMode::SenseInterruptStatus;
-                return;
-
-            case 0x0A: // FDC Read ID but without MF
-                TODO();
-            case 0x4A: // FDC Read ID
-                DC_CORE_INFO("[FDC]: ReadID command received");
-                m_FDCmode = FDCMode::ReadID;
-                m_lastCommandByteWritten = 0; // We need one more byte
-                return;
-
-            case 0xE6: //???
-                TODO();
-                break;
-
-            default:
-                TODO();
-                return;
+                DC_CORE_TRACE("[FDC]: Turning on Drive {0} motor ON", drivenum);
+                m_drives[drivenum].motorActive = true;
             }
-            VERIFY_NOT_REACHED();
-            break;
         }
-        case FDCMode::Specify:
-            DC_CORE_TRACE("[FDC]: Sense{0}: Ignoring value 0x{1:X}", m_lastCommandByteWritten + 1, data);
-            if (m_lastCommandByteWritten == 1)
+        else
+        {
+            if (m_drives[drivenum].motorActive)
             {
-                m_FDCmode = FDCMode::Nothing;
+                DC_CORE_TRACE("[FDC]: Turning on Drive {0} motor OFF", drivenum);
+                m_drives[drivenum].motorActive = false;
+                m_drives[drivenum].headLoaded = false;
             }
-            break;
+        }
+    }
 
-        case FDCMode::Recalibrate:
-            // Only one additional byte - drive select
-            if (data == 0)
-                DC_CORE_TRACE("[FDC]: Recalibrate1: Working on drive 0");
-            else
-                TODO();
-            m_FDCmode = FDCMode::Nothing;
-            // We also need to set status register 0 here
-            m_statusRegister0 = 0xC0;
-            // We need to perform an interrupt here
-            m_performInterruptAfterFIFO = true;
-            m_busy = true;
+    void FloppyDiskController::startCommand()
+    {
+        auto command = (FDCCommand)(m_command[0] & 0x1F);
+        DC_CORE_TRACE("[FDC]: Command 0x{0:X}", m_command[0]);
+
+        // These answer straight away without an execution phase or interrupt
+        switch (command)
+        {
+        case FDCCommand::Specify:
+            if (IS_BIT_SET(m_command[2], 0))
+                DC_CORE_WARN("[FDC]: Non-DMA mode isn't supported");
+            m_stepRateTime = m_command[1] >> 4;
+            m_headLoadTime = m_command[2] >> 1;
+            return finishCommand({}, false);
+
+        case FDCCommand::SenseDriveStatus:
+            return finishCommand({ senseDriveStatus() }, false);
+
+        case FDCCommand::SenseInterruptStatus:
+        {
+            if (m_interruptStatus.empty())
+                return finishCommand({ ST0_INVALID_COMMAND }, false);
+
+            auto [status, cylinder] = m_interruptStatus.front();
+            m_interruptStatus.pop_front();
+            m_seekingDrives &= ~BIT(status & 0x3);
+            return finishCommand({ status, cylinder }, false);
+        }
+
+        case FDCCommand::Version:
+            return finishCommand({ 0x80 }, false);
+
+        case FDCCommand::Recalibrate:
+        case FDCCommand::Seek:
+            SET_BIT(m_seekingDrives, m_command[1] & 0x3);
             break;
 
-        case FDCMode::ReadID:
-            DC_CORE_TRACE("[FDC]: ReadID");
-            m_direction = TransferDirection::FromControllerToSystem;
-            // Result 6: Bytes per sector
-            m_outputBuffer.push_back(0x02); // Somehow means 512k
-            // Result 5: Sector number
-            m_outputBuffer.push_back(1);
-            // Result 4: Head number
-            m_outputBuffer.push_back(0); // Uhh, head 0?
-            // Result 3: Cylinder number
-            m_outputBuffer.push_back(0); // The one we're on rn?
-            // Result 2: Status register 2
-            m_outputBuffer.push_back(m_statusRegister2);
-            // Result 1: Status register 1
-            m_outputBuffer.push_back(m_statusRegister1);
-            // Result 0: Status register 0
-            m_outputBuffer.push_back(0x0D); // technically, this gets accessed as ST1. Override this as a temp thing to get it working
-            m_performInterruptAfterFIFO = true;
+        default:
             break;
+        }
 
-        case FDCMode::SenseInterruptStatus:
-            DC_CORE_ERROR("[FDC]: SenseInterruptStatus doesn't require any more command writes, please read twice to reset");
-            VERIFY_NOT_REACHED();
+        m_phase = FDCPhase::Execution;
+        m_eventRequested = true;
+    }
+
+    uint64_t FloppyDiskController::getExecutionDelay(uint64_t now)
+    {
+        uint64_t delay = FLOPPY_INSTANT_DELAY * CPU_CLOCK_DIVIDER;
+        if (m_timing == DiskTiming::Instant || m_phase != FDCPhase::Execution)
+            return delay;
+
+        auto command = (FDCCommand)(m_command[0] & 0x1F);
+        auto& drive = m_drives[m_command[1] & 0x3];
+        if (command == FDCCommand::Recalibrate)
+            return std::max(delay, getSeekTime(drive.cylinder));
+        if (command == FDCCommand::Seek)
+            return std::max(delay, getSeekTime(std::abs(m_command[2] - drive.cylinder)));
+
+        // Without a disk nothing comes past the head and the command fails straight away
+        if (!drive.disk)
+            return delay;
+
+        // The head loads the first time it's needed after the motor comes on
+        uint64_t headLoad = 0;
+        if (!drive.headLoaded)
+        {
+            unsigned int headLoadTime = m_headLoadTime ? m_headLoadTime : 128;
+            headLoad = microsecondsToMasterTicks((uint64_t)headLoadTime * 2000 * 500 / s_dataRates[m_dataRate]);
+            drive.headLoaded = true;
+        }
+
+        DiskRotation rotation = { revolutionsPerMinuteToMasterTicks(FLOPPY_RPM), drive.disk->getGeometry().sectorsPerTrack };
+        uint64_t start = now + headLoad;
+        switch (command)
+        {
+        case FDCCommand::ReadData:
+        case FDCCommand::ReadDeletedData:
+        case FDCCommand::WriteData:
+        case FDCCommand::WriteDeletedData:
+            delay = headLoad + rotation.getTimeUntilSector(start, m_command[4]) + getTransferSectorCount(m_command[4]) * rotation.getSectorTime();
+            break;
+        case FDCCommand::ReadTrack:
+            delay = headLoad + rotation.getTimeUntilIndex(start) + getTransferSectorCount(1) * rotation.getSectorTime();
+            break;
+        case FDCCommand::FormatTrack:
+            delay = headLoad + rotation.getTimeUntilIndex(start) + rotation.revolution;
+            break;
+        case FDCCommand::ReadID:
+            delay = headLoad + rotation.getSectorTime() - start % rotation.getSectorTime();
             break;
         default:
-            TODO();
             break;
         }
-        m_lastCommandByteWritten++;
+        return std::max(delay, (uint64_t)FLOPPY_INSTANT_DELAY * CPU_CLOCK_DIVIDER);
     }
 
-    uint8_t FloppyDiskController::readDigitalInputRegister()
+    uint64_t FloppyDiskController::getSeekTime(unsigned int steps) const
     {
-        DC_CORE_TRACE("[FDC]: Read digital input register");
+        if (steps == 0)
+            return 0;
 
+        // SRT counts down from 16 ms
+        uint64_t stepTime = (uint64_t)(16 - m_stepRateTime) * 1000 * 500 / s_dataRates[m_dataRate];
+        return microsecondsToMasterTicks(steps * stepTime + FLOPPY_HEAD_SETTLE_TIME);
+    }
 
-        //return 0x81; // bit 7 and bit 0 set - diskette change and high-density select
-        return 1;
+    unsigned int FloppyDiskController::getTransferSectorCount(unsigned int firstSector) const
+    {
+        // Up to the end of the track (or cylinder with MT), unless DMA runs out first
+        unsigned int endOfTrack = m_command[6];
+        unsigned int sectors = endOfTrack >= firstSector ? endOfTrack - firstSector + 1 : 1;
+        if (IS_BIT_SET(m_command[0], 7) && IS_BIT_NOT_SET(m_command[1], 2))
+            sectors += endOfTrack;
+
+        size_t DMASectors = (m_DMA.getRemainingCount(DMA_CHANNEL_FLOPPY) + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        return std::max(1u, std::min(sectors, (unsigned int)DMASectors));
     }
 
-    void FloppyDiskController::writeConfigurationControlRegister(uint8_t value)
+    void FloppyDiskController::executeCommand()
     {
-        // Bits 0 and 1 specify the speed
-        DC_CORE_TRACE("[FDC]: Writing configuration control register");
+        switch ((FDCCommand)(m_command[0] & 0x1F))
+        {
+        case FDCCommand::Recalibrate:
+            return seek(m_command[1] & 0x3, 0, 0);
+        case FDCCommand::Seek:
+            return seek(m_command[1] & 0x3, (m_command[1] >> 2) & 1, m_command[2]);
+        case FDCCommand::ReadData:
+        case FDCCommand::ReadDeletedData:
+            return transferData(false, false);
+        case FDCCommand::ReadTrack:
+            return transferData(false, true);
+        case FDCCommand::WriteData:
+        case FDCCommand::WriteDeletedData:
+            return transferData(true, false);
+        case FDCCommand::FormatTrack:
+            return formatTrack();
+        case FDCCommand::ReadID:
+            return readID();
+        default:
+            VERIFY_NOT_REACHED();
+        }
+    }
 
-        if (value == 0)
-            DC_CORE_TRACE("[FDC]: We have a 1.44 MB diskette :)");
-        else
-            TODO();
+    void FloppyDiskController::finishCommand(std::initializer_list<uint8_t> result, bool interrupt)
+    {
+        m_command.clear();
+        m_result = result;
+        m_phase = m_result.empty() ? FDCPhase::Command : FDCPhase::Result;
 
-        // TODO: Figure out where this should be set
-        m_direction = TransferDirection::FromSystemToController;
+        if (interrupt && isIRQEnabled())
+            pulseIRQ();
+    }
+
+    void FloppyDiskController::seek(uint8_t drive, uint8_t head, uint8_t cylinder)
+    {
+        DC_CORE_TRACE("[FDC]: Drive {0} seeking from cylinder {1} to {2}", drive, m_drives[drive].cylinder, cylinder);
+        m_drives[drive].cylinder = cylinder;
+        m_interruptStatus.push_back({ (uint8_t)(ST0_SEEK_END | head << 2 | drive), cylinder });
+        finishCommand({}, true);
     }
 
-    bool FloppyDiskController::performInterruptAfterFIFO()
+    void FloppyDiskController::transferData(bool write, bool wholeTrack)
     {
-        if (m_performInterruptAfterFIFO)
+        uint8_t driveNumber = m_command[1] & 0x3;
+        uint8_t head = (m_command[1] >> 2) & 1;
+        uint8_t cylinder = m_command[2];
+        uint8_t idHead = m_command[3];
+        uint8_t sector = wholeTrack ? 1 : m_command[4];
+        uint8_t sizeCode = m_command[5];
+        uint8_t endOfTrack = m_command[6];
+        bool multiTrack = IS_BIT_SET(m_command[0], 7) && !wholeTrack;
+
+        auto& drive = m_drives[driveNumber];
+        uint8_t status1 = 0;
+        uint8_t status2 = 0;
+
+        // Sector by sector until DMA reaches terminal count or the end of the track (or cylinder with MT) is passed
+        while (true)
         {
-            m_performInterruptAfterFIFO = false;
-            return true;
+            FloppyTrack* track = getTrack(drive, head);
+            if (!track)
+            {
+                status1 |= ST1_MISSING_ADDRESS_MARK;
+                break;
+            }
+            if (cylinder != drive.cylinder)
+            {
+                status1 |= ST1_NO_DATA;
+                status2 |= ST2_WRONG_CYLINDER;
+                break;
+            }
+            if (idHead != head || sizeCode != SECTOR_SIZE_CODE || sector == 0 || sector > drive.disk->getGeometry().sectorsPerTrack)
+            {
+                status1 |= ST1_NO_DATA;
+                break;
+            }
+
+            DMATransfer transfer;
+            if (write)
+            {
+                // A sector cut short by terminal count is padded with zeroes
+                uint8_t buffer[SECTOR_SIZE] = {};
+                transfer = m_DMA.readFromMemory(DMA_CHANNEL_FLOPPY, buffer, SECTOR_SIZE);
+                if (transfer.length > 0)
+                    writeSector(drive, *track, sector, buffer);
+            }
+            else
+            {
+                transfer = m_DMA.writeToMemory(DMA_CHANNEL_FLOPPY, &track->data[(sector - 1) * SECTOR_SIZE], SECTOR_SIZE);
+            }
+
+            if (transfer.length == 0)
+            {
+                DC_CORE_WARN("[FDC]: DMA channel {0} isn't ready", DMA_CHANNEL_FLOPPY);
+                status1 |= ST1_OVERRUN;
+                break;
+            }
+
+            // The result points at the sector after the last one transferred
+            bool endOfCylinder = false;
+            if (sector == endOfTrack)
+            {
+                sector = 1;
+                if (multiTrack && head == 0)
+                {
+                    // MT carries on with the other head
+                    head = 1;
+                    idHead = 1;
+                }
+                else
+                {
+                    if (multiTrack)
+                        head = 0;
+                    cylinder++;
+                    endOfCylinder = true;
+                }
+            }
+            else
+            {
+                sector++;
+            }
+
+            if (transfer.terminalCount)
+                break;
+            if (endOfCylinder)
+            {
+                status1 |= ST1_END_OF_CYLINDER;
+                break;
+            }
         }
-        return false;
+
+        uint8_t status0 = head << 2 | driveNumber;
+        if (status1 || status2)
+            status0 |= ST0_ABNORMAL_TERMINATION;
+
+        finishCommand({ status0, status1, status2, cylinder, head, sector, sizeCode }, true);
     }
 
-    void FloppyDiskController::updateDriveMotor(uint8_t boolean, unsigned int drivenum)
+    void FloppyDiskController::formatTrack()
     {
-        if (boolean)
+        uint8_t driveNumber = m_command[1] & 0x3;
+        uint8_t head = (m_command[1] >> 2) & 1;
+        uint8_t sizeCode = m_command[2];
+        uint8_t sectorCount = m_command[3];
+        uint8_t filler = m_command[5];
+
+        auto& drive = m_drives[driveNumber];
+        uint8_t status1 = 0;
+        uint8_t id[4] = { drive.cylinder, head, 0, sizeCode };
+
+        FloppyTrack* track = getTrack(drive, head);
+        if (!track)
+            status1 |= ST1_MISSING_ADDRESS_MARK;
+
+        // DMA supplies the C, H, R and N of every sector ID on the track
+        std::vector<uint8_t> data(SECTOR_SIZE, filler);
+        for (uint8_t i = 0; status1 == 0 && i < sectorCount; i++)
         {
-            if (!m_drives[drivenum].motorActive)
+            DMATransfer transfer = m_DMA.readFromMemory(DMA_CHANNEL_FLOPPY, id, sizeof(id));
+            if (transfer.length < sizeof(id))
             {
-                DC_CORE_TRACE("[FDC]: Turning on Drive {0} motor ON", drivenum);
-                m_drives[drivenum].motorActive = true;
+                status1 |= ST1_OVERRUN;
+                break;
             }
+
+            // A plain image only holds the standard layout, anything else can't be stored
+            if (id[0] != drive.cylinder || id[1] != head || id[3] != SECTOR_SIZE_CODE || id[2] == 0 || id[2] > drive.disk->getGeometry().sectorsPerTrack)
+                DC_CORE_WARN("[FDC]: Can't format sector {0:X}:{1:X}:{2:X} with size code {3} into the image", id[0], id[1], id[2], id[3]);
+            else
+                writeSector(drive, *track, id[2], data.data());
+
+            if (transfer.terminalCount)
+                break;
         }
-        else
+
+        uint8_t status0 = head << 2 | driveNumber;
+        if (status1)
+            status0 |= ST0_ABNORMAL_TERMINATION;
+
+        finishCommand({ status0, status1, 0, id[0], id[1], id[2], id[3] }, true);
+    }
+
+    void FloppyDiskController::readID()
+    {
+        uint8_t driveNumber = m_command[1] & 0x3;
+        uint8_t head = (m_command[1] >> 2) & 1;
+        auto& drive = m_drives[driveNumber];
+
+        uint8_t status0 = head << 2 | driveNumber;
+        if (!getTrack(drive, head))
+            return finishCommand({ (uint8_t)(status0 | ST0_ABNORMAL_TERMINATION), ST1_MISSING_ADDRESS_MARK, 0, 0, 0, 0, 0 }, true);
+
+        // The first ID to come past the head, which is always sector 1 here
+        finishCommand({ status0, 0, 0, drive.cylinder, head, 1, SECTOR_SIZE_CODE }, true);
+    }
+
+    uint8_t FloppyDiskController::senseDriveStatus()
+    {
+        uint8_t driveNumber = m_command[1] & 0x3;
+        auto& drive = m_drives[driveNumber];
+
+        // Status register 3: ready, two-sided and track 0. Writes never fail, so nothing is write protected
+        uint8_t status = m_command[1] & 0x7;
+        SET_BIT(status, 5);
+        if (!drive.disk || drive.disk->getGeometry().heads > 1)
+            SET_BIT(status, 3);
+        if (drive.cylinder == 0)
+            SET_BIT(status, 4);
+        return status;
+    }
+
+    FloppyTrack* FloppyDiskController::getTrack(FloppyDiskDrive& drive, uint8_t head)
+    {
+        if (!drive.disk || !drive.disk->isOpen())
+            return nullptr;
+
+        if (drive.cachedGeneration != drive.disk->getWriteGeneration())
         {
-            if (m_drives[drivenum].motorActive)
+            drive.trackCache.clear();
+            drive.cachedGeneration = drive.disk->getWriteGeneration();
+        }
+
+        for (auto it = drive.trackCache.begin(); it != drive.trackCache.end(); it++)
+        {
+            if (it->cylinder == drive.cylinder && it->head == head)
             {
-                DC_CORE_TRACE("[FDC]: Turning on Drive {0} motor OFF", drivenum);
-                m_drives[drivenum].motorActive = false;
+                drive.trackCache.splice(drive.trackCache.begin(), drive.trackCache, it);
+                return &drive.trackCache.front();
             }
         }
+
+        unsigned int sectorsPerTrack = drive.disk->getGeometry().sectorsPerTrack;
+        size_t lba = drive.disk->toLBA(drive.cylinder, head, 1);
+        if (lba == INVALID_LBA)
+            return nullptr;
+
+        FloppyTrack track = { drive.cylinder, head, std::vector<uint8_t>((size_t)sectorsPerTrack * SECTOR_SIZE) };
+        drive.disk->readSectors(lba, sectorsPerTrack, track.data.data());
+
+        drive.trackCache.push_front(std::move(track));
+        if (drive.trackCache.size() > FLOPPY_TRACK_CACHE_SIZE)
+            drive.trackCache.pop_back();
+        return &drive.trackCache.front();
+    }
+
+    void FloppyDiskController::writeSector(FloppyDiskDrive& drive, FloppyTrack& track, uint8_t sector, const uint8_t* data)
+    {
+        memcpy(&track.data[(sector - 1) * SECTOR_SIZE], data, SECTOR_SIZE);
+
+        // Straight through to the backend, the cache never holds anything newer. It already has this write, so it stays valid
+        drive.disk->writeSector(drive.disk->toLBA(track.cylinder, track.head, sector), data);
+        drive.cachedGeneration = drive.disk->getWriteGeneration();
     }
 }
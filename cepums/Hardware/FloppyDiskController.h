@@ -1,57 +1,147 @@
-#pragma once
-
-namespace Cepums {
-
-    enum class TransferDirection
-    {
-        FromSystemToController,
-        FromControllerToSystem
-    };
-
-    enum class FDCMode
-    {
-        Nothing,
-        Specify = 0x03,
-        Recalibrate = 0x07,
-        SenseInterruptStatus = 0x08,
-        ReadID = 0x4A
-    };
-
-    struct FloppyDiskDrive
-    {
-        bool motorActive = false;
-    };
-
-    class FloppyDiskController
-    {
-    public:
-        uint8_t readStatusRegisterA();
-        uint8_t readStatusRegisterB();
-        void writeDigitalOutputRegister(uint8_t value);
-
-        uint8_t readMainStatusRegister();
-
-        uint8_t readDataFIFO();
-        void writeDataFIFO(uint8_t data);
-
-        uint8_t readDigitalInputRegister();
-        void writeConfigurationControlRegister(uint8_t value);
-
-        bool performInterruptAfterFIFO();
-    private:
-        void updateDriveMotor(uint8_t boolean, unsigned int drivenum);
-    private:
-        int m_lastCommandByteWritten = 0;
-        bool m_performInterruptAfterFIFO = false;
-        bool m_returnSenseInterruptStatus = false;
-        bool m_busy = false;
-        TransferDirection m_direction = TransferDirection::FromSystemToController;
-        std::vector<uint8_t> m_outputBuffer;
-        FloppyDiskDrive m_drives[4];
-        FDCMode m_FDCmode = FDCMode::Nothing;
-        uint8_t m_statusRegister0 = 0xC0;
-        uint8_t m_statusRegister1 = 0xC0;
-        uint8_t m_statusRegister2 = 0xC0;
-        bool m_IRQenabled = false;
-    };
-}
+#pragma once
+
+#include <deque>
+#include <list>
+
+#include "DMAController.h"
+#include "IODevice.h"
+#include "Storage/DiskBackend.h"
+#include "Storage/DiskTiming.h"
+
+#define FLOPPY_DRIVE_COUNT 4
+
+// Tracks kept in memory per drive
+#define FLOPPY_TRACK_CACHE_SIZE 8
+
+namespace Cepums {
+
+    // Low 5 bits of the first command byte, the top 3 are the MT, MFM and SK flags
+    enum class FDCCommand
+    {
+        ReadTrack = 0x02,
+        Specify = 0x03,
+        SenseDriveStatus = 0x04,
+        WriteData = 0x05,
+        ReadData = 0x06,
+        Recalibrate = 0x07,
+        SenseInterruptStatus = 0x08,
+        WriteDeletedData = 0x09,
+        ReadID = 0x0A,
+        ReadDeletedData = 0x0C,
+        FormatTrack = 0x0D,
+        Seek = 0x0F,
+        Version = 0x10
+    };
+
+    enum class FDCPhase
+    {
+        Command,
+        Execution,
+        Result
+    };
+
+    // One side of one cylinder, copied out of the image
+    struct FloppyTrack
+    {
+        uint8_t cylinder;
+        uint8_t head;
+        std::vector<uint8_t> data;
+    };
+
+    struct FloppyDiskDrive
+    {
+        bool motorActive = false;
+        uint8_t cylinder = 0; // Where the head actually is
+        bool headLoaded = false;
+        DiskBackend* disk = nullptr;
+
+        // Most recently used first. Dropped when something other than the FDC writes the disk, like INT 13h emulation
+        std::list<FloppyTrack> trackCache;
+        uint64_t cachedGeneration = 0;
+    };
+
+    // NEC uPD765 floppy disk controller behind the AT style DOR, MSR and DIR registers.
+    // Commands run as a whole when their execution phase comes up, and data moves through DMA channel 2 a sector at a time
+    class FloppyDiskController : public IODevice
+    {
+    public:
+        FloppyDiskController(DMAController& DMA, DiskTiming timing);
+
+        // nullptr leaves the drive empty
+        void insertDisk(uint8_t drive, DiskBackend* disk);
+
+        // The standard PC format of an image of this size, 160K through 2.88M. Returns false for any other size
+        static bool getGeometryForSize(size_t size, DiskGeometry& geometry);
+
+        // The CMOS drive type that takes disks with this layout, 0 if there is none
+        static uint8_t getCMOSDriveType(const DiskGeometry& geometry);
+
+        const char* getName() const override { return "FDC"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x3F0, 0x3F7 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        // The execution phase and its interrupt come a while after the last command byte
+        uint64_t getNextEventTime(uint64_t now) override;
+        void runEvent(uint64_t time) override;
+
+        uint8_t readStatusRegisterA();
+        uint8_t readStatusRegisterB();
+        void writeDigitalOutputRegister(uint8_t value);
+
+        uint8_t readMainStatusRegister();
+
+        uint8_t readDataFIFO();
+        void writeDataFIFO(uint8_t data);
+
+        uint8_t readDigitalInputRegister();
+        void writeConfigurationControlRegister(uint8_t value);
+    private:
+        void reset();
+        void updateDriveMotor(uint8_t boolean, unsigned int drivenum);
+
+        void startCommand();
+        uint64_t getExecutionDelay(uint64_t now);
+        uint64_t getSeekTime(unsigned int steps) const;
+        unsigned int getTransferSectorCount(unsigned int firstSector) const;
+        void executeCommand();
+        void finishCommand(std::initializer_list<uint8_t> result, bool interrupt);
+
+        // Command execution phases
+        void seek(uint8_t drive, uint8_t head, uint8_t cylinder);
+        void transferData(bool write, bool wholeTrack);
+        void formatTrack();
+        void readID();
+        uint8_t senseDriveStatus();
+
+        // Track cache. Returns nullptr for sectors outside of the disk
+        FloppyTrack* getTrack(FloppyDiskDrive& drive, uint8_t head);
+        void writeSector(FloppyDiskDrive& drive, FloppyTrack& track, uint8_t sector, const uint8_t* data);
+
+        bool isIRQEnabled() const { return IS_BIT_SET(m_DOR, 3); }
+    private:
+        DMAController& m_DMA;
+        DiskTiming m_timing;
+        FloppyDiskDrive m_drives[FLOPPY_DRIVE_COUNT];
+
+        uint8_t m_DOR = 0;
+        uint8_t m_dataRate = 0;
+
+        // From SPECIFY, for realistic timing
+        uint8_t m_stepRateTime = 0;
+        uint8_t m_headLoadTime = 0;
+
+        FDCPhase m_phase = FDCPhase::Command;
+        std::vector<uint8_t> m_command;
+        size_t m_commandLength = 0;
+        std::deque<uint8_t> m_result;
+
+        // ST0 and present cylinder for each interrupt Sense Interrupt Status hasn't picked up yet
+        std::deque<std::pair<uint8_t, uint8_t>> m_interruptStatus;
+        uint8_t m_seekingDrives = 0;
+
+        // Execution phase, or the interrupt after a reset
+        bool m_eventRequested = false;
+        uint64_t m_eventTime = NO_EVENT;
+    };
+}
@@ -0,0 +1,531 @@
+#include "cepumspch.h"
+#include "HardDiskController.h"
+
+#include <cstring>
+
+// Status register
+#define STATUS_ERROR 0x01
+#define STATUS_DATA_REQUEST 0x08
+#define STATUS_SEEK_COMPLETE 0x10
+#define STATUS_READY 0x40
+#define STATUS_BUSY 0x80
+
+// Error register
+#define ERROR_ABORTED 0x04
+#define ERROR_ID_NOT_FOUND 0x10
+
+// Device control register
+#define CONTROL_INTERRUPT_DISABLE 1
+#define CONTROL_SOFTWARE_RESET 2
+
+// Drive/head register
+#define DRIVE_HEAD_LBA 6
+
+// Realistic timing, roughly a 3600 RPM stepper drive of the XT era
+#define HARD_DISK_RPM 3600
+#define HARD_DISK_SEEK_TIME 15000 // Microseconds to start moving and settle
+#define HARD_DISK_STEP_TIME 100 // Microseconds per cylinder crossed
+
+namespace Cepums {
+
+    // ATA strings are space padded with the two characters of every word swapped
+    static void writeIdentifyString(uint16_t* words, size_t wordCount, const char* text)
+    {
+        size_t length = strlen(text);
+        for (size_t i = 0; i < wordCount * 2; i++)
+        {
+            uint8_t character = i < length ? text[i] : ' ';
+            if (i & 1)
+                words[i / 2] |= character;
+            else
+                words[i / 2] = character << 8;
+        }
+    }
+
+    HardDiskController::HardDiskController(DiskTiming timing)
+        : m_timing(timing)
+    {
+    }
+
+    uint8_t HardDiskController::readPort(uint16_t port)
+    {
+        switch (port - HARD_DISK_BASE_PORT)
+        {
+        case 0x0: // Data, the high byte waits in the latch
+        {
+            uint16_t data = readData();
+            m_dataHigh = data >> 8;
+            return data & 0xFF;
+        }
+        case 0x1:
+            return m_error;
+        case 0x2:
+            return m_sectorCount;
+        case 0x3:
+            return m_sectorNumber;
+        case 0x4:
+            return m_cylinder & 0xFF;
+        case 0x5:
+            return m_cylinder >> 8;
+        case 0x6:
+            return m_driveHead;
+        case 0x7:
+        case 0xE: // Alternate status
+            return readStatus();
+        case 0x8:
+            return m_dataHigh;
+        default:
+            return IODevice::readPort(port);
+        }
+    }
+
+    void HardDiskController::writePort(uint16_t port, uint8_t value)
+    {
+        switch (port - HARD_DISK_BASE_PORT)
+        {
+        case 0x0: // Data, with the high byte from the latch
+            return writeData((uint16_t)m_dataHigh << 8 | value);
+        case 0x1:
+            m_features = value;
+            return;
+        case 0x2:
+            m_sectorCount = value;
+            return;
+        case 0x3:
+            m_sectorNumber = value;
+            return;
+        case 0x4:
+            m_cylinder = (m_cylinder & 0xFF00) | value;
+            return;
+        case 0x5:
+            m_cylinder = (m_cylinder & 0x00FF) | (uint16_t)value << 8;
+            return;
+        case 0x6:
+            m_driveHead = value | 0xA0;
+            return;
+        case 0x7:
+            return writeCommand(value);
+        case 0x8:
+            m_dataHigh = value;
+            return;
+        case 0xE:
+            return writeDeviceControl(value);
+        default:
+            return IODevice::writePort(port, value);
+        }
+    }
+
+    uint16_t HardDiskController::readPortWord(uint16_t port)
+    {
+        if (port != HARD_DISK_BASE_PORT)
+            return IODevice::readPortWord(port);
+        return readData();
+    }
+
+    void HardDiskController::writePortWord(uint16_t port, uint16_t value)
+    {
+        if (port != HARD_DISK_BASE_PORT)
+            return IODevice::writePortWord(port, value);
+        writeData(value);
+    }
+
+    uint64_t HardDiskController::getNextEventTime(uint64_t now)
+    {
+        if (m_eventRequested)
+        {
+            m_eventRequested = false;
+            m_eventTime = now + getAccessTime(now);
+        }
+        return m_eventTime;
+    }
+
+    void HardDiskController::runEvent(uint64_t time)
+    {
+        m_eventTime = NO_EVENT;
+        auto operation = m_pendingOperation;
+        m_pendingOperation = HardDiskOperation::None;
+
+        // A software reset drops whatever the drive was doing
+        if (IS_BIT_SET(m_deviceControl, CONTROL_SOFTWARE_RESET))
+            return;
+        runOperation(operation);
+    }
+
+    void HardDiskController::insertDisk(DiskBackend* disk)
+    {
+        m_disk = disk;
+        reset();
+    }
+
+    DiskGeometry HardDiskController::getGeometryForSize(size_t size)
+    {
+        DiskGeometry geometry;
+        geometry.sectorsPerTrack = 17;
+        geometry.heads = 4;
+
+        size_t sectors = (size + SECTOR_SIZE - 1) / SECTOR_SIZE;
+        size_t cylinders;
+        while ((cylinders = (sectors + geometry.heads * geometry.sectorsPerTrack - 1) / (geometry.heads * geometry.sectorsPerTrack)) > 1024)
+            geometry.heads *= 2;
+        geometry.cylinders = (unsigned int)cylinders;
+        return geometry;
+    }
+
+    uint8_t HardDiskController::readStatus()
+    {
+        // Nothing answers for the slave
+        if (isSlaveSelected())
+            return 0;
+        return m_status;
+    }
+
+    void HardDiskController::writeDeviceControl(uint8_t value)
+    {
+        bool wasResetting = IS_BIT_SET(m_deviceControl, CONTROL_SOFTWARE_RESET);
+        m_deviceControl = value;
+
+        if (IS_BIT_SET(value, CONTROL_SOFTWARE_RESET))
+            m_status = STATUS_BUSY;
+        else if (wasResetting)
+            reset();
+    }
+
+    void HardDiskController::writeCommand(uint8_t command)
+    {
+        if (isSlaveSelected() || (m_status & STATUS_BUSY))
+            return;
+
+        DC_CORE_TRACE("[XT-IDE]: Command 0x{0:X}", command);
+        m_error = 0;
+        m_identifying = false;
+
+        switch (command)
+        {
+        case 0x20: // READ SECTORS
+        case 0x21:
+            return startTransfer(false, 1);
+        case 0x30: // WRITE SECTORS
+        case 0x31:
+            return startTransfer(true, 1);
+        case 0xC4: // READ MULTIPLE
+            if (m_multipleCount == 0)
+                return abortCommand(ERROR_ABORTED);
+            return startTransfer(false, m_multipleCount);
+        case 0xC5: // WRITE MULTIPLE
+            if (m_multipleCount == 0)
+                return abortCommand(ERROR_ABORTED);
+            return startTransfer(true, m_multipleCount);
+
+        case 0xC6: // SET MULTIPLE MODE, a power of two up to the maximum
+            if (m_sectorCount > HARD_DISK_MAX_MULTIPLE || (m_sectorCount & (m_sectorCount - 1)) != 0)
+                return abortCommand(ERROR_ABORTED);
+            m_multipleCount = m_sectorCount;
+            break;
+
+        case 0x40: // READ VERIFY SECTORS
+        case 0x41:
+        {
+            unsigned int count = m_sectorCount ? m_sectorCount : 256;
+            size_t lba = getAddress();
+            if (lba == INVALID_LBA || lba + count > m_disk->getGeometry().getSectorCount())
+                return abortCommand(ERROR_ID_NOT_FOUND);
+            setAddress(lba + count - 1);
+            m_sectorCount = 0;
+            return access(HardDiskOperation::Complete, lba, count);
+        }
+
+        case 0x70: // SEEK
+        {
+            size_t lba = getAddress();
+            if (lba == INVALID_LBA)
+                return abortCommand(ERROR_ID_NOT_FOUND);
+            return access(HardDiskOperation::Complete, lba, 0);
+        }
+
+        case 0x90: // EXECUTE DEVICE DIAGNOSTIC
+            reset();
+            break;
+
+        case 0x91: // INITIALIZE DEVICE PARAMETERS
+            m_logicalHeads = (m_driveHead & 0xF) + 1;
+            m_logicalSectors = m_sectorCount;
+            break;
+
+        case 0xEC: // IDENTIFY DEVICE
+            return identify();
+
+        case 0xEF: // SET FEATURES. The XT-IDE BIOS asks for 8-bit transfers, which the latch takes care of
+            DC_CORE_TRACE("[XT-IDE]: Set feature 0x{0:X}", m_features);
+            break;
+
+        default:
+            // RECALIBRATE takes up a whole range of opcodes
+            if ((command & 0xF0) == 0x10)
+            {
+                m_cylinder = 0;
+                return access(HardDiskOperation::Complete, 0, 0);
+            }
+            DC_CORE_WARN("[XT-IDE]: Unsupported command 0x{0:X}", command);
+            return abortCommand(ERROR_ABORTED);
+        }
+
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE;
+        interrupt();
+    }
+
+    void HardDiskController::reset()
+    {
+        // Diagnostic passed, and the task file holds the ATA signature
+        m_error = 0x01;
+        m_sectorCount = 1;
+        m_sectorNumber = 1;
+        m_cylinder = 0;
+        m_driveHead = 0xA0;
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE;
+
+        m_buffer.clear();
+        m_bufferPosition = 0;
+        m_sectorsLeft = 0;
+        m_identifying = false;
+        m_multipleCount = 0;
+
+        m_pendingOperation = HardDiskOperation::None;
+        m_eventRequested = false;
+        m_eventTime = NO_EVENT;
+
+        if (m_disk)
+        {
+            m_logicalHeads = m_disk->getGeometry().heads;
+            m_logicalSectors = m_disk->getGeometry().sectorsPerTrack;
+        }
+    }
+
+    uint16_t HardDiskController::readData()
+    {
+        if (!(m_status & STATUS_DATA_REQUEST) || m_writing)
+        {
+            DC_CORE_WARN("[XT-IDE]: Reading data without a transfer going on");
+            return 0xFFFF;
+        }
+
+        uint16_t data = m_buffer[m_bufferPosition] | (uint16_t)m_buffer[m_bufferPosition + 1] << 8;
+        m_bufferPosition += 2;
+        if (m_bufferPosition == m_buffer.size())
+            finishBlock();
+        return data;
+    }
+
+    void HardDiskController::writeData(uint16_t value)
+    {
+        if (!(m_status & STATUS_DATA_REQUEST) || !m_writing)
+        {
+            DC_CORE_WARN("[XT-IDE]: Writing data without a transfer going on");
+            return;
+        }
+
+        m_buffer[m_bufferPosition] = value & 0xFF;
+        m_buffer[m_bufferPosition + 1] = value >> 8;
+        m_bufferPosition += 2;
+        if (m_bufferPosition == m_buffer.size())
+            finishBlock();
+    }
+
+    size_t HardDiskController::getAddress() const
+    {
+        if (IS_BIT_SET(m_driveHead, DRIVE_HEAD_LBA))
+            return (size_t)(m_driveHead & 0xF) << 24 | (size_t)m_cylinder << 8 | m_sectorNumber;
+
+        unsigned int head = m_driveHead & 0xF;
+        if (m_sectorNumber == 0 || m_sectorNumber > m_logicalSectors || head >= m_logicalHeads)
+            return INVALID_LBA;
+        return ((size_t)m_cylinder * m_logicalHeads + head) * m_logicalSectors + m_sectorNumber - 1;
+    }
+
+    void HardDiskController::setAddress(size_t lba)
+    {
+        if (IS_BIT_SET(m_driveHead, DRIVE_HEAD_LBA))
+        {
+            m_sectorNumber = lba & 0xFF;
+            m_cylinder = (lba >> 8) & 0xFFFF;
+            m_driveHead = (m_driveHead & 0xF0) | ((lba >> 24) & 0xF);
+            return;
+        }
+
+        m_sectorNumber = (uint8_t)(lba % m_logicalSectors + 1);
+        size_t track = lba / m_logicalSectors;
+        m_driveHead = (m_driveHead & 0xF0) | (uint8_t)(track % m_logicalHeads);
+        m_cylinder = (uint16_t)(track / m_logicalHeads);
+    }
+
+    void HardDiskController::startTransfer(bool write, unsigned int blockSize)
+    {
+        unsigned int count = m_sectorCount ? m_sectorCount : 256;
+        size_t lba = getAddress();
+        if (lba == INVALID_LBA || lba + count > m_disk->getGeometry().getSectorCount())
+            return abortCommand(ERROR_ID_NOT_FOUND);
+
+        m_writing = write;
+        m_nextLBA = lba;
+        m_sectorsLeft = count;
+        m_blockSize = blockSize;
+
+        if (!m_writing)
+            return access(HardDiskOperation::ReadBlock, m_nextLBA, std::min(m_sectorsLeft, m_blockSize));
+
+        // The first block of a write goes without an interrupt, the drive only gets busy once it has the data
+        m_buffer.resize((size_t)std::min(m_sectorsLeft, m_blockSize) * SECTOR_SIZE);
+        m_bufferPosition = 0;
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE | STATUS_DATA_REQUEST;
+    }
+
+    void HardDiskController::access(HardDiskOperation operation, size_t lba, unsigned int sectors)
+    {
+        if (m_timing == DiskTiming::Instant)
+            return runOperation(operation);
+
+        m_status = STATUS_BUSY;
+        m_pendingOperation = operation;
+        m_accessLBA = lba;
+        m_accessSectors = sectors;
+        m_eventRequested = true;
+    }
+
+    uint64_t HardDiskController::getAccessTime(uint64_t now)
+    {
+        auto& geometry = m_disk->getGeometry();
+        uint64_t time = 0;
+
+        unsigned int cylinder = (unsigned int)(m_accessLBA / geometry.sectorsPerTrack / geometry.heads);
+        if (cylinder != m_headCylinder)
+        {
+            unsigned int distance = cylinder > m_headCylinder ? cylinder - m_headCylinder : m_headCylinder - cylinder;
+            time = microsecondsToMasterTicks(HARD_DISK_SEEK_TIME + (uint64_t)distance * HARD_DISK_STEP_TIME);
+            m_headCylinder = cylinder;
+        }
+        if (m_accessSectors == 0)
+            return time;
+
+        // Head switches within a cylinder are free
+        DiskRotation rotation = { revolutionsPerMinuteToMasterTicks(HARD_DISK_RPM), geometry.sectorsPerTrack };
+        unsigned int sector = (unsigned int)(m_accessLBA % geometry.sectorsPerTrack) + 1;
+        return time + rotation.getTimeUntilSector(now + time, sector) + m_accessSectors * rotation.getSectorTime();
+    }
+
+    void HardDiskController::runOperation(HardDiskOperation operation)
+    {
+        switch (operation)
+        {
+        case HardDiskOperation::ReadBlock:
+            return loadBlock();
+        case HardDiskOperation::WriteBlock:
+            return requestWriteBlock();
+        case HardDiskOperation::Complete:
+            m_status = STATUS_READY | STATUS_SEEK_COMPLETE;
+            return interrupt();
+        default:
+            VERIFY_NOT_REACHED();
+        }
+    }
+
+    void HardDiskController::loadBlock()
+    {
+        unsigned int sectors = std::min(m_sectorsLeft, m_blockSize);
+        m_buffer.resize((size_t)sectors * SECTOR_SIZE);
+        m_disk->readSectors(m_nextLBA, sectors, m_buffer.data());
+        m_bufferPosition = 0;
+
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE | STATUS_DATA_REQUEST;
+        interrupt();
+    }
+
+    void HardDiskController::finishBlock()
+    {
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE;
+        if (m_identifying)
+        {
+            m_identifying = false;
+            return;
+        }
+
+        size_t lba = m_nextLBA;
+        unsigned int sectors = (unsigned int)(m_buffer.size() / SECTOR_SIZE);
+        if (m_writing)
+            m_disk->writeSectors(lba, sectors, m_buffer.data());
+
+        // The task file ends up pointing at the last sector that was transferred
+        m_nextLBA += sectors;
+        m_sectorsLeft -= sectors;
+        setAddress(m_nextLBA - 1);
+        m_sectorCount = (uint8_t)m_sectorsLeft;
+
+        // A written block has to reach the platters before the drive asks for more
+        if (m_writing)
+            return access(m_sectorsLeft ? HardDiskOperation::WriteBlock : HardDiskOperation::Complete, lba, sectors);
+        if (m_sectorsLeft)
+            access(HardDiskOperation::ReadBlock, m_nextLBA, std::min(m_sectorsLeft, m_blockSize));
+    }
+
+    void HardDiskController::requestWriteBlock()
+    {
+        m_buffer.resize((size_t)std::min(m_sectorsLeft, m_blockSize) * SECTOR_SIZE);
+        m_bufferPosition = 0;
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE | STATUS_DATA_REQUEST;
+        interrupt();
+    }
+
+    void HardDiskController::identify()
+    {
+        auto& geometry = m_disk->getGeometry();
+        uint16_t words[256] = {};
+        uint32_t sectors = (uint32_t)geometry.getSectorCount();
+        uint32_t logicalSectors = m_logicalHeads * m_logicalSectors * geometry.cylinders;
+
+        words[0] = 0x0040; // Fixed disk
+        words[1] = geometry.cylinders;
+        words[3] = geometry.heads;
+        words[5] = SECTOR_SIZE;
+        words[6] = geometry.sectorsPerTrack;
+        writeIdentifyString(&words[10], 10, "CEPUMS86");
+        writeIdentifyString(&words[23], 4, "1.0");
+        writeIdentifyString(&words[27], 20, "Cepums-86 XT-IDE disk");
+        words[47] = 0x8000 | HARD_DISK_MAX_MULTIPLE;
+        words[49] = 0x0200; // LBA
+        words[51] = 0x0200; // PIO mode 2
+        words[53] = 0x0001; // Words 54-58 are valid
+        words[54] = geometry.cylinders;
+        words[55] = m_logicalHeads;
+        words[56] = m_logicalSectors;
+        words[57] = logicalSectors & 0xFFFF;
+        words[58] = logicalSectors >> 16;
+        words[59] = m_multipleCount ? 0x0100 | m_multipleCount : 0;
+        words[60] = sectors & 0xFFFF;
+        words[61] = sectors >> 16;
+
+        m_buffer.resize(sizeof(words));
+        for (size_t i = 0; i < 256; i++)
+        {
+            m_buffer[i * 2] = words[i] & 0xFF;
+            m_buffer[i * 2 + 1] = words[i] >> 8;
+        }
+        m_bufferPosition = 0;
+        m_writing = false;
+        m_identifying = true;
+
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE | STATUS_DATA_REQUEST;
+        interrupt();
+    }
+
+    void HardDiskController::abortCommand(uint8_t error)
+    {
+        m_error = error;
+        m_status = STATUS_READY | STATUS_SEEK_COMPLETE | STATUS_ERROR;
+        m_sectorsLeft = 0;
+        interrupt();
+    }
+
+    void HardDiskController::interrupt()
+    {
+        if (IS_BIT_NOT_SET(m_deviceControl, CONTROL_INTERRUPT_DISABLE))
+            pulseIRQ();
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "IODevice.h"
+#include "Storage/DiskBackend.h"
+#include "Storage/DiskTiming.h"
+
+// Task file at 0x300-0x307, the XT-IDE data high byte latch at 0x308 and device control at 0x30E
+#define HARD_DISK_BASE_PORT 0x300
+
+// DOS before 4.0 can't use anything bigger
+#define HARD_DISK_MAX_SIZE (32 * 1024 * 1024)
+
+// Sectors READ/WRITE MULTIPLE can move per block
+#define HARD_DISK_MAX_MULTIPLE 16
+
+namespace Cepums {
+
+    // What the drive does once it has finished seeking and waiting for the sectors
+    enum class HardDiskOperation
+    {
+        None,
+        ReadBlock, // Load the next block and ask for it to be read
+        WriteBlock, // Ask for the next block to be written
+        Complete // Interrupt with the command done
+    };
+
+    // XT-IDE style 8-bit ATA interface with a single master drive. Whole blocks of sectors are copied in and out
+    // of the disk at once and the data register also takes word accesses. With instant timing commands finish
+    // right away, with realistic timing the drive stays busy while it seeks and the platters turn
+    class HardDiskController : public IODevice
+    {
+    public:
+        HardDiskController(DiskTiming timing);
+
+        const char* getName() const override { return "XT-IDE"; }
+        std::vector<PortRange> getPortRanges() const override
+        {
+            return { { HARD_DISK_BASE_PORT, HARD_DISK_BASE_PORT + 8 }, { HARD_DISK_BASE_PORT + 0xE, HARD_DISK_BASE_PORT + 0xE } };
+        }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        std::vector<PortRange> getWordPortRanges() const override { return { { HARD_DISK_BASE_PORT, HARD_DISK_BASE_PORT } }; }
+        uint16_t readPortWord(uint16_t port) override;
+        void writePortWord(uint16_t port, uint16_t value) override;
+
+        uint64_t getNextEventTime(uint64_t now) override;
+        void runEvent(uint64_t time) override;
+
+        void insertDisk(DiskBackend* disk);
+
+        // Heads and sectors per track that cover an image of this size, like a typical XT era drive
+        static DiskGeometry getGeometryForSize(size_t size);
+    private:
+        uint8_t readStatus();
+        void writeDeviceControl(uint8_t value);
+        void writeCommand(uint8_t command);
+        void reset();
+
+        uint16_t readData();
+        void writeData(uint16_t value);
+
+        // The task file's address, CHS through the logical geometry or LBA
+        size_t getAddress() const;
+        void setAddress(size_t lba);
+
+        void startTransfer(bool write, unsigned int blockSize);
+        void access(HardDiskOperation operation, size_t lba, unsigned int sectors);
+        uint64_t getAccessTime(uint64_t now);
+        void runOperation(HardDiskOperation operation);
+        void loadBlock();
+        void requestWriteBlock();
+        void finishBlock();
+        void identify();
+        void abortCommand(uint8_t error);
+        void interrupt();
+
+        bool isSlaveSelected() const { return IS_BIT_SET(m_driveHead, 4); }
+    private:
+        DiskBackend* m_disk = nullptr;
+        DiskTiming m_timing;
+
+        // Task file
+        uint8_t m_error = 0;
+        uint8_t m_features = 0;
+        uint8_t m_sectorCount = 0;
+        uint8_t m_sectorNumber = 0;
+        uint16_t m_cylinder = 0;
+        uint8_t m_driveHead = 0xA0;
+        uint8_t m_status = 0;
+        uint8_t m_deviceControl = 0;
+        uint8_t m_dataHigh = 0;
+
+        // Set by INITIALIZE DEVICE PARAMETERS, used for CHS addressing
+        unsigned int m_logicalHeads = 0;
+        unsigned int m_logicalSectors = 0;
+        unsigned int m_multipleCount = 0;
+
+        // PIO data phase
+        std::vector<uint8_t> m_buffer;
+        size_t m_bufferPosition = 0;
+        bool m_writing = false;
+        bool m_identifying = false;
+        size_t m_nextLBA = 0;
+        unsigned int m_sectorsLeft = 0;
+        unsigned int m_blockSize = 1;
+
+        // Realistic timing, the operation waiting for the drive to get to the sectors
+        HardDiskOperation m_pendingOperation = HardDiskOperation::None;
+        size_t m_accessLBA = 0;
+        unsigned int m_accessSectors = 0;
+        unsigned int m_headCylinder = 0; // Physical cylinder the heads are over
+        bool m_eventRequested = false;
+        uint64_t m_eventTime = NO_EVENT;
+    };
+}
@@ -0,0 +1,46 @@
+#include "cepumspch.h"
+#include "IODevice.h"
+
+#include "PIC.h"
+
+namespace Cepums {
+
+    uint8_t IODevice::readPort(uint16_t port)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled read at 0x{1:X}", getName(), port);
+        return 0xFF;
+    }
+
+    void IODevice::writePort(uint16_t port, uint8_t value)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled write at 0x{1:X} with data 0x{2:X}", getName(), port, value);
+    }
+
+    uint16_t IODevice::readPortWord(uint16_t port)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled word read at 0x{1:X}", getName(), port);
+        return 0xFFFF;
+    }
+
+    void IODevice::writePortWord(uint16_t port, uint16_t value)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled word write at 0x{1:X} with data 0x{2:X}", getName(), port, value);
+    }
+
+    uint8_t IODevice::readMemory(uint32_t address)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled memory read at 0x{1:X}", getName(), address);
+        return 0xFF;
+    }
+
+    void IODevice::writeMemory(uint32_t address, uint8_t value)
+    {
+        DC_CORE_WARN("[{0}]: Unhandled memory write at 0x{1:X} with data 0x{2:X}", getName(), address, value);
+    }
+
+    void IODevice::pulseIRQ()
+    {
+        if (m_PIC)
+            m_PIC->pulseIRQ(m_IRQ);
+    }
+}
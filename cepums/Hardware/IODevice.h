@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "Scheduler.h"
+
+namespace Cepums {
+
+    class PIC;
+
+    // Both ends are included
+    struct PortRange
+    {
+        uint16_t first;
+        uint16_t last;
+    };
+
+    struct MemoryRange
+    {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    // Anything that sits on the bus. A device declares the ports and memory it answers to,
+    // and the IOManager and MemoryManager build their dispatch tables from that when it's registered
+    class IODevice
+    {
+    public:
+        virtual ~IODevice() = default;
+
+        virtual const char* getName() const = 0;
+
+        virtual std::vector<PortRange> getPortRanges() const { return {}; }
+        virtual uint8_t readPort(uint16_t port);
+        virtual void writePort(uint16_t port, uint8_t value);
+
+        // Ports that take 16-bit accesses in one go. Word accesses anywhere else are split into two byte accesses
+        virtual std::vector<PortRange> getWordPortRanges() const { return {}; }
+        virtual uint16_t readPortWord(uint16_t port);
+        virtual void writePortWord(uint16_t port, uint16_t value);
+
+        virtual std::vector<MemoryRange> getMemoryRanges() const { return {}; }
+        virtual uint8_t readMemory(uint32_t address);
+        virtual void writeMemory(uint32_t address, uint8_t value);
+
+        // When the device next has to run on its own, in master clock ticks (NO_EVENT if it doesn't).
+        // It's asked again after every port access and every run, so the answer only has to hold until then
+        virtual uint64_t getNextEventTime(uint64_t now) { return NO_EVENT; }
+        virtual void runEvent(uint64_t time) {}
+
+        virtual void serialize(std::ostream& stream) const {}
+        virtual void restore(std::istream& stream) {}
+
+        // Wires the device's interrupt output to a PIC input
+        void connectIRQ(PIC& pic, uint8_t irq) { m_PIC = &pic; m_IRQ = irq; }
+    protected:
+        void pulseIRQ();
+
+        template<typename T>
+        static void writeState(std::ostream& stream, const T& value) { stream.write((const char*)&value, sizeof(T)); }
+
+        template<typename T>
+        static void readState(std::istream& stream, T& value) { stream.read((char*)&value, sizeof(T)); }
+    private:
+        PIC* m_PIC = nullptr;
+        uint8_t m_IRQ = 0;
+    };
+}
@@ -115,6 +115,26 @@ namespace Cepums {
     5. Write out CMD_TEST_PS2_CONTROLLER command;
     */
 
+    uint8_t KeyboardController::readPort(uint16_t port)
+    {
+        if (port == 0x64)
+            return readStatusRegister();
+
+        uint8_t data = readDataPort();
+
+        // The KBC interrupts again as soon as the next byte is in its output buffer
+        if (hasPendingData())
+            pulseIRQ();
+        return data;
+    }
+
+    void KeyboardController::writePort(uint16_t port, uint8_t value)
+    {
+        if (port == 0x64)
+            return writeCommandRegister(value);
+        writeDataPort(value);
+    }
+
     void KeyboardController::writeCommandRegister(uint8_t value)
     {
         if (value == CMD_WRITE_CONFIGURATION_BYTE)
@@ -218,8 +238,8 @@ namespace Cepums {
             {
             case CMD_DEV_RESET:
                 DC_CORE_TRACE("KB: Reset :)");
-                m_dataBuffer.push_back(CMD_BAT_PASSED);
                 m_dataBuffer.push_back(CMD_DEV_ACK);
+                m_dataBuffer.push_back(CMD_BAT_PASSED);
                 m_keyboardEnabled = false;
                 return;
             case CMD_DEV_DISABLE:
@@ -275,8 +295,8 @@ namespace Cepums {
 
             if (m_dataBuffer.size() > 0)
             {
-                uint8_t data = m_dataBuffer.back();
-                m_dataBuffer.pop_back();
+                uint8_t data = m_dataBuffer.front();
+                m_dataBuffer.pop_front();
 
                 return data;
             }
@@ -331,8 +351,6 @@ namespace Cepums {
 
     void KeyboardController::keyPressed(SDL_Scancode scancode)
     {
-        // TODO: Mutex this somehow
-
         uint8_t byte = getByteFromSimpleScancode(scancode);
         if (byte != 0)
         {
@@ -346,8 +364,6 @@ namespace Cepums {
 
     void KeyboardController::keyReleased(SDL_Scancode scancode)
     {
-        // TODO: Mutex this somehow
-
         uint8_t byte = getByteFromSimpleScancode(scancode);
         if (byte != 0)
         {
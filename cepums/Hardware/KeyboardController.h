@@ -1,5 +1,9 @@
 #pragma once
 
+#include <deque>
+
+#include "IODevice.h"
+
 // Just the SDL scan codes
 #include <SDL_scancode.h>
 
@@ -39,14 +43,23 @@ namespace Cepums {
         DisableKeyboard
     };
 
-    class KeyboardController
+    class KeyboardController : public IODevice
     {
     public:
+        const char* getName() const override { return "KBC"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x60, 0x60 }, { 0x64, 0x64 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
         void writeCommandRegister(uint8_t value);
         void writeDataPort(uint8_t value);
 
         uint8_t readDataPort();
         uint8_t readStatusRegister();
+
+        // Scancodes waiting to be read by the system
+        bool hasPendingData() const { return m_state == KeyboardControllerState::EnableKeyboard && !m_dataBuffer.empty(); }
+
         void keyPressed(SDL_Scancode scancode);
         void keyReleased(SDL_Scancode scancode);
     private:
@@ -55,7 +68,7 @@ namespace Cepums {
         KeyboardControllerState m_state = KeyboardControllerState::OK;
         uint8_t m_commandByte = 0;
         bool m_keyboardEnabled = false;
-        std::vector<uint8_t> m_dataBuffer;
+        std::deque<uint8_t> m_dataBuffer; // Output buffer, read in the order it was filled
         bool m_dataToMouse = false;
     };
 }
@@ -0,0 +1,177 @@
+#include "cepumspch.h"
+#include "MDA.h"
+
+namespace Cepums {
+
+    bool loadMDAFont(std::vector<uint8_t>& font)
+    {
+        std::ifstream fontStream("default-font.bin", std::ios::in | std::ios::binary);
+        if (!fontStream)
+        {
+            DC_CORE_ERROR("Font loader failed to open 'default-font.bin' font file");
+            return false;
+        }
+
+        font.resize(MDA_FONT_SIZE);
+        fontStream.read((char*)font.data(), MDA_FONT_SIZE);
+        return true;
+    }
+
+    std::string MDAToText(const std::vector<uint8_t>& mda)
+    {
+        std::string text;
+        text.reserve((MDA_COLUMNS + 1) * MDA_ROWS);
+
+        for (auto y = 0; y < MDA_ROWS; y++)
+        {
+            for (auto x = 0; x < MDA_COLUMNS; x++)
+            {
+                uint8_t character = mda.at(x * 2 + 160 * y);
+                const MDAAttribute& attribute = s_MDAAttributeTable[mda.at((x * 2 + 160 * y) + 1)];
+
+                if (attribute.isBlank() || character == 0x00 || character == 0xFF)
+                    text += ' ';
+                else if (character >= 0x20 && character < 0x7F)
+                    text += (char)character;
+                else
+                    text += '.';
+            }
+            text += '\n';
+        }
+
+        return text;
+    }
+
+    void rasterizeMDA(const std::vector<uint8_t>& mda, const std::vector<uint8_t>& font, std::vector<uint8_t>& framebuffer, bool showBlinking)
+    {
+        framebuffer.assign(MDA_SCREEN_WIDTH * MDA_SCREEN_HEIGHT * 3, 0x00);
+
+        for (auto y = 0; y < MDA_ROWS; y++)
+        {
+            for (auto x = 0; x < MDA_COLUMNS; x++)
+            {
+                uint8_t character = mda.at(x * 2 + 160 * y);
+                const MDAAttribute& attribute = s_MDAAttributeTable[mda.at((x * 2 + 160 * y) + 1)];
+
+                if (attribute.isBlank())
+                    continue;
+
+                auto& foreground = s_MDAPalette[(size_t)attribute.foreground];
+                auto& background = s_MDAPalette[(size_t)attribute.background];
+                bool visible = !attribute.blink || showBlinking;
+
+                for (auto row = 0; row < MDA_CELL_HEIGHT; row++)
+                {
+                    uint8_t line = font.at(character * MDA_CELL_HEIGHT + row);
+                    if (attribute.underline && row == MDA_UNDERLINE_ROW)
+                        line = 0xFF;
+                    if (!visible)
+                        line = 0x00;
+
+                    uint8_t* pixel = &framebuffer[((y * MDA_CELL_HEIGHT + row) * MDA_SCREEN_WIDTH + x * MDA_CELL_WIDTH) * 3];
+                    for (auto column = 0; column < MDA_CELL_WIDTH; column++)
+                    {
+                        // The 9th column is always background
+                        auto& color = (column < 8 && (line & (0x80 >> column))) ? foreground : background;
+                        *pixel++ = color.r;
+                        *pixel++ = color.g;
+                        *pixel++ = color.b;
+                    }
+                }
+            }
+        }
+    }
+
+    MDA::MDA()
+    {
+        m_videoRAM.resize(MDA_VIDEO_RAM_SIZE);
+    }
+
+    uint8_t MDA::readPort(uint16_t port)
+    {
+        // Status register
+        if (port == 0x3BA)
+        {
+            uint8_t data = 0;
+            /*
+            bit 4-7 always 1
+            bit 3:  Video. This is 1 if a green or bright green pixel is being drawn on the screen at this moment
+            bit 1-2 always 0
+            bit 0   Retrace. This is 1 if the horizontal retrace is active
+            */
+            if (m_pretendRetrace)
+            {
+                SET_BIT(data, 0);
+                m_pretendRetrace = false;
+            }
+            else
+            {
+                m_pretendRetrace = true;
+            }
+            SET_BIT(data, 4);
+            SET_BIT(data, 5);
+            SET_BIT(data, 6);
+            SET_BIT(data, 7);
+
+            return data;
+        }
+
+        switch (port)
+        {
+        case 0x3B4: // The CRTC index and data registers are write-only, nothing drives the bus
+        case 0x3B5:
+        case 0x3B8: // So is the mode control register
+        case 0x3B9:
+            return 0xFF;
+
+        default:
+            return IODevice::readPort(port);
+        }
+    }
+
+    void MDA::writePort(uint16_t port, uint8_t value)
+    {
+        switch (port)
+        {
+        case 0x3B4: // Set current CRTC data register (accessable on 0x03B5 then)
+        case 0x3B5:
+            return;
+
+        case 0x3B8: // Mode control register
+            // Disable video output and set the high-resolution bit
+            if (value == 0x01)
+                return DC_CORE_TRACE("[MDA]: Disable output and set high-res bit");
+
+            // Mode set
+            if (value == 0x29)
+                return DC_CORE_TRACE("[MDA]: Set mode");
+
+            return DC_CORE_ERROR("[MDA]: Unhandled register value {0:X}", value);
+
+        case 0x3B9: // CGA color select register
+            return DC_CORE_TRACE("[CGA] Dummy color select register write with value {0}", value);
+
+        default:
+            return IODevice::writePort(port, value);
+        }
+    }
+
+    uint8_t MDA::readMemory(uint32_t address)
+    {
+        // The address repeats for the entire 32k range
+        std::lock_guard<std::mutex> guard(m_videoRAMMutex);
+        return m_videoRAM[(address - 0xB0000) % MDA_VIDEO_RAM_SIZE];
+    }
+
+    void MDA::writeMemory(uint32_t address, uint8_t value)
+    {
+        std::lock_guard<std::mutex> guard(m_videoRAMMutex);
+        m_videoRAM[(address - 0xB0000) % MDA_VIDEO_RAM_SIZE] = value;
+    }
+
+    std::vector<uint8_t> MDA::getVideoRAM()
+    {
+        std::lock_guard<std::mutex> guard(m_videoRAMMutex);
+        return m_videoRAM;
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "IODevice.h"
+
+#define MDA_COLUMNS 80
+#define MDA_ROWS 25
+
+#define MDA_CELL_WIDTH 9
+#define MDA_CELL_HEIGHT 16
+#define MDA_UNDERLINE_ROW 14
+
+#define MDA_FONT_SIZE (256 * MDA_CELL_HEIGHT)
+#define MDA_SCREEN_WIDTH (MDA_COLUMNS * MDA_CELL_WIDTH)
+#define MDA_SCREEN_HEIGHT (MDA_ROWS * MDA_CELL_HEIGHT)
+
+#define MDA_VIDEO_RAM_SIZE (MDA_COLUMNS * MDA_ROWS * 2)
+
+namespace Cepums {
+
+    enum class MDAColor : uint8_t
+    {
+        Black,
+        Regular,
+        Intense
+    };
+
+    struct MDAColorRGB
+    {
+        uint8_t r;
+        uint8_t g;
+        uint8_t b;
+    };
+
+    // Indexed by MDAColor
+    constexpr MDAColorRGB s_MDAPalette[] = {
+        { 0x00, 0x00, 0x00 }, // Black
+        { 0xCC, 0x99, 0x00 }, // Regular
+        { 0xFF, 0xCF, 0x00 }, // Intense
+    };
+
+    // Everything a renderer needs to know to draw a cell with a given attribute
+    struct MDAAttribute
+    {
+        MDAColor foreground = MDAColor::Black;
+        MDAColor background = MDAColor::Black;
+        bool underline = false;
+        bool blink = false;
+
+        // Blank cells (and inverted cells without a visible glyph) have nothing to draw on top of the background
+        constexpr bool isBlank() const { return foreground == background; }
+    };
+
+    constexpr MDAAttribute decodeMDAAttribute(uint8_t attribute)
+    {
+        MDAAttribute decoded;
+
+        /*
+        bit 7   blink (or high intensity background if blinking is disabled)
+        bit 3   high intensity
+        bit 0-2 001 is underline
+        Attributes 0x00, 0x08, 0x80 and 0x88 are blank
+        Attributes 0x70, 0x78, 0xF0 and 0xF8 are inverted
+        */
+        bool intense = (attribute >> 3) & 1U;
+        MDAColor color = intense ? MDAColor::Intense : MDAColor::Regular;
+
+        decoded.blink = (attribute >> 7) & 1U;
+
+        switch (attribute & 0x77)
+        {
+        case 0x00: // Blank
+            return decoded;
+        case 0x70: // Inverted, the character is drawn in black
+            decoded.background = color;
+            return decoded;
+        default:
+            break;
+        }
+
+        decoded.foreground = color;
+        decoded.underline = (attribute & 0x07) == 0x01;
+        return decoded;
+    }
+
+    constexpr std::array<MDAAttribute, 256> generateMDAAttributeTable()
+    {
+        std::array<MDAAttribute, 256> table{};
+        for (auto i = 0; i < 256; i++)
+            table[i] = decodeMDAAttribute(static_cast<uint8_t>(i));
+        return table;
+    }
+
+    // All MDA renderers should go through this instead of decoding the attribute byte themselves
+    constexpr std::array<MDAAttribute, 256> s_MDAAttributeTable = generateMDAAttributeTable();
+
+    static_assert(s_MDAAttributeTable[0x07].foreground == MDAColor::Regular && !s_MDAAttributeTable[0x07].underline, "Normal text");
+    static_assert(s_MDAAttributeTable[0x01].underline, "Underlined text");
+    static_assert(s_MDAAttributeTable[0x0F].foreground == MDAColor::Intense, "Intense text");
+    static_assert(s_MDAAttributeTable[0x88].isBlank() && s_MDAAttributeTable[0x88].blink, "Blank text");
+    static_assert(s_MDAAttributeTable[0xF8].background == MDAColor::Intense && s_MDAAttributeTable[0xF8].foreground == MDAColor::Black, "Inverted text");
+
+    // Loads the 8x16 font from 'default-font.bin'
+    bool loadMDAFont(std::vector<uint8_t>& font);
+
+    // Converts the MDA RAM into 25 lines of ASCII text. Blank cells and unprintable characters become spaces and dots
+    std::string MDAToText(const std::vector<uint8_t>& mda);
+
+    // Draws the MDA RAM into a MDA_SCREEN_WIDTH x MDA_SCREEN_HEIGHT RGB24 framebuffer
+    void rasterizeMDA(const std::vector<uint8_t>& mda, const std::vector<uint8_t>& font, std::vector<uint8_t>& framebuffer, bool showBlinking);
+
+    // The adapter itself: video RAM repeated over B0000-B7FFF and the CRTC/mode ports
+    class MDA : public IODevice
+    {
+    public:
+        MDA();
+
+        const char* getName() const override { return "MDA"; }
+        // CRTC index and data, then mode control, color select and status. 3B6h and 3B7h aren't decoded
+        std::vector<PortRange> getPortRanges() const override { return { { 0x3B4, 0x3B5 }, { 0x3B8, 0x3BA } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        std::vector<MemoryRange> getMemoryRanges() const override { return { { 0xB0000, 0xB7FFF } }; }
+        uint8_t readMemory(uint32_t address) override;
+        void writeMemory(uint32_t address, uint8_t value) override;
+
+        // A copy of the video RAM for the renderers, can be called from any thread
+        std::vector<uint8_t> getVideoRAM();
+    private:
+        std::vector<uint8_t> m_videoRAM;
+        std::mutex m_videoRAMMutex;
+        bool m_pretendRetrace = false;
+    };
+}
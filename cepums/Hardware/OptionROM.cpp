@@ -0,0 +1,58 @@
+#include "cepumspch.h"
+#include "OptionROM.h"
+
+#include "MemoryManager.h"
+
+#include <numeric>
+
+#define OPTION_ROM_SIGNATURE 0xAA55
+
+// The size byte counts 512 byte blocks
+#define OPTION_ROM_BLOCK_SIZE 512
+
+namespace Cepums {
+
+    std::vector<MemoryRange> OptionROM::getMemoryRanges() const
+    {
+        return { { m_address, m_address + (uint32_t)m_data.size() - 1 } };
+    }
+
+    uint8_t OptionROM::readMemory(uint32_t address)
+    {
+        return m_data[address - m_address];
+    }
+
+    bool OptionROM::load(const std::string& path, uint32_t address)
+    {
+        std::ifstream stream(path, std::ios::in | std::ios::binary);
+        if (!stream)
+        {
+            DC_CORE_ERROR("[OptionROM]: Can't open option ROM {0}", path);
+            return false;
+        }
+        std::vector<uint8_t> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+        if (data.empty() || address + data.size() > OPTION_ROM_AREA_END)
+        {
+            DC_CORE_ERROR("[OptionROM]: Option ROM {0} doesn't fit between 0x{1:X} and 0x{2:X}", path, address, OPTION_ROM_AREA_END);
+            return false;
+        }
+
+        // The BIOS skips ROMs without the signature or with a bad checksum, which is easy to miss
+        size_t declaredSize = data.size() >= 3 ? data[2] * OPTION_ROM_BLOCK_SIZE : 0;
+        if (data.size() < 3 || (data[0] | data[1] << 8) != OPTION_ROM_SIGNATURE)
+            DC_CORE_WARN("[OptionROM]: {0} has no option ROM signature, the BIOS won't run it", path);
+        else if (declaredSize > data.size())
+            DC_CORE_WARN("[OptionROM]: {0} is shorter than the {1} bytes it says it is", path, declaredSize);
+        else if (std::accumulate(data.begin(), data.begin() + declaredSize, 0u) & 0xFF)
+            DC_CORE_WARN("[OptionROM]: {0} has a bad checksum, the BIOS won't run it", path);
+
+        size_t pageSize = 1 << MEMORY_PAGE_SHIFT;
+        data.resize((data.size() + pageSize - 1) / pageSize * pageSize, 0xFF);
+
+        m_address = address;
+        m_data = std::move(data);
+        DC_CORE_INFO("[OptionROM]: Using {0} as the option ROM at 0x{1:X}", path, address);
+        return true;
+    }
+}
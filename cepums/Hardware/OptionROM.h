@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "IODevice.h"
+
+// Where an XT's BIOS starts looking for option ROMs, and where the XT-IDE Universal BIOS usually sits
+#define OPTION_ROM_ADDRESS 0xC8000
+
+// The BIOS scans up to F4000h, but F0000h is ours
+#define OPTION_ROM_AREA_END 0xF0000
+
+namespace Cepums {
+
+    // The ROM of an expansion card, like the XT-IDE Universal BIOS for the hard disk controller.
+    // The BIOS finds it by its 55h AAh signature and calls it to install its handlers
+    class OptionROM : public IODevice
+    {
+    public:
+        const char* getName() const override { return "OptionROM"; }
+        std::vector<MemoryRange> getMemoryRanges() const override;
+        uint8_t readMemory(uint32_t address) override;
+        void writeMemory(uint32_t address, uint8_t value) override {}
+
+        // Reads the image in, padded with FFh to whole memory pages
+        bool load(const std::string& path, uint32_t address);
+        bool isLoaded() const { return !m_data.empty(); }
+    private:
+        uint32_t m_address = 0;
+        std::vector<uint8_t> m_data;
+    };
+}
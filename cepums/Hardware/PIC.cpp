@@ -0,0 +1,298 @@
+#include "cepumspch.h"
+#include "PIC.h"
+
+// ICW1
+#define ICW1_NEED_ICW4 0
+#define ICW1_SINGLE 1
+#define ICW1_LEVEL_TRIGGERED 3
+#define ICW1_SELECT 4
+
+// ICW4
+#define ICW4_AUTO_EOI 1
+
+// OCW3
+#define OCW3_READ_ISR 0
+#define OCW3_READ_REGISTER 1
+#define OCW3_POLL 2
+#define OCW3_SELECT 3
+#define OCW3_SPECIAL_MASK 5
+#define OCW3_SET_SPECIAL_MASK 6
+
+namespace Cepums {
+
+    uint8_t PIC::readPort(uint16_t port)
+    {
+        if (port == 0x20)
+            return readCommandRegister();
+        return readDataRegister();
+    }
+
+    void PIC::writePort(uint16_t port, uint8_t value)
+    {
+        if (port == 0x20)
+            return writeCommandRegister(value);
+        writeDataRegister(value);
+    }
+
+    void PIC::serialize(std::ostream& stream) const
+    {
+        writeState(stream, m_IRR);
+        writeState(stream, m_ISR);
+        writeState(stream, m_IMR);
+        writeState(stream, m_lines);
+        writeState(stream, m_vectorBase);
+        writeState(stream, m_lowestPriority);
+        writeState(stream, m_levelTriggered);
+        writeState(stream, m_autoEOI);
+        writeState(stream, m_rotateOnAutoEOI);
+        writeState(stream, m_specialMaskMode);
+        writeState(stream, m_readISR);
+        writeState(stream, m_poll);
+        writeState(stream, m_initState);
+        writeState(stream, m_singleMode);
+        writeState(stream, m_needICW4);
+    }
+
+    void PIC::restore(std::istream& stream)
+    {
+        readState(stream, m_IRR);
+        readState(stream, m_ISR);
+        readState(stream, m_IMR);
+        readState(stream, m_lines);
+        readState(stream, m_vectorBase);
+        readState(stream, m_lowestPriority);
+        readState(stream, m_levelTriggered);
+        readState(stream, m_autoEOI);
+        readState(stream, m_rotateOnAutoEOI);
+        readState(stream, m_specialMaskMode);
+        readState(stream, m_readISR);
+        readState(stream, m_poll);
+        readState(stream, m_initState);
+        readState(stream, m_singleMode);
+        readState(stream, m_needICW4);
+        update();
+    }
+
+    uint8_t PIC::readCommandRegister()
+    {
+        // Poll command: the next read acknowledges the highest request and returns its level
+        if (m_poll)
+        {
+            m_poll = false;
+            int level = resolveRequest();
+            if (level < 0)
+                return 0;
+
+            acknowledge();
+            return 0x80 | level;
+        }
+
+        return m_readISR ? m_ISR : m_IRR;
+    }
+
+    void PIC::writeCommandRegister(uint8_t value)
+    {
+        // ICW1 starts the initialization sequence
+        if (IS_BIT_SET(value, ICW1_SELECT))
+        {
+            DC_CORE_TRACE("[PIC]: ICW1 0x{0:X}", value);
+            m_levelTriggered = IS_BIT_SET(value, ICW1_LEVEL_TRIGGERED);
+            m_singleMode = IS_BIT_SET(value, ICW1_SINGLE);
+            m_needICW4 = IS_BIT_SET(value, ICW1_NEED_ICW4);
+
+            m_IRR = m_levelTriggered ? m_lines : 0;
+            m_ISR = 0;
+            m_IMR = 0;
+            m_lowestPriority = 7;
+            m_autoEOI = false;
+            m_rotateOnAutoEOI = false;
+            m_specialMaskMode = false;
+            m_readISR = false;
+            m_poll = false;
+
+            m_initState = PICInitState::WaitingForICW2;
+            update();
+            return;
+        }
+
+        // OCW3
+        if (IS_BIT_SET(value, OCW3_SELECT))
+        {
+            if (IS_BIT_SET(value, OCW3_POLL))
+                m_poll = true;
+            if (IS_BIT_SET(value, OCW3_READ_REGISTER))
+                m_readISR = IS_BIT_SET(value, OCW3_READ_ISR);
+            if (IS_BIT_SET(value, OCW3_SET_SPECIAL_MASK))
+                m_specialMaskMode = IS_BIT_SET(value, OCW3_SPECIAL_MASK);
+
+            update();
+            return;
+        }
+
+        // OCW2
+        uint8_t level = value & 0x7;
+        switch (value >> 5)
+        {
+        case 0b001: // Non-specific EOI
+            return endOfInterrupt(highestInService(), false);
+        case 0b011: // Specific EOI
+            return endOfInterrupt(level, false);
+        case 0b101: // Rotate on non-specific EOI
+            return endOfInterrupt(highestInService(), true);
+        case 0b111: // Rotate on specific EOI
+            return endOfInterrupt(level, true);
+        case 0b100: // Rotate in automatic EOI mode (set)
+            m_rotateOnAutoEOI = true;
+            return;
+        case 0b000: // Rotate in automatic EOI mode (clear)
+            m_rotateOnAutoEOI = false;
+            return;
+        case 0b110: // Set priority
+            m_lowestPriority = level;
+            return update();
+        case 0b010: // No operation
+            return;
+        default:
+            VERIFY_NOT_REACHED();
+            break;
+        }
+    }
+
+    uint8_t PIC::readDataRegister()
+    {
+        return m_IMR;
+    }
+
+    void PIC::writeDataRegister(uint8_t value)
+    {
+        switch (m_initState)
+        {
+        case PICInitState::WaitingForICW2:
+            DC_CORE_TRACE("[PIC]: ICW2, vectors start at 0x{0:X}", value & 0xF8);
+            m_vectorBase = value & 0xF8;
+            if (!m_singleMode)
+                m_initState = PICInitState::WaitingForICW3;
+            else if (m_needICW4)
+                m_initState = PICInitState::WaitingForICW4;
+            else
+                m_initState = PICInitState::Ready;
+            return;
+
+        case PICInitState::WaitingForICW3:
+            // There's nothing cascaded in an XT
+            DC_CORE_TRACE("[PIC]: Ignoring ICW3 0x{0:X}", value);
+            m_initState = m_needICW4 ? PICInitState::WaitingForICW4 : PICInitState::Ready;
+            return;
+
+        case PICInitState::WaitingForICW4:
+            DC_CORE_TRACE("[PIC]: ICW4 0x{0:X}", value);
+            m_autoEOI = IS_BIT_SET(value, ICW4_AUTO_EOI);
+            m_initState = PICInitState::Ready;
+            return;
+
+        case PICInitState::Ready:
+            // OCW1
+            m_IMR = value;
+            return update();
+
+        default:
+            VERIFY_NOT_REACHED();
+            break;
+        }
+    }
+
+    void PIC::raiseIRQ(uint8_t irq)
+    {
+        // Edge triggered requests are only latched on the rising edge
+        if (IS_BIT_NOT_SET(m_lines, irq) || m_levelTriggered)
+            m_IRR |= BIT(irq);
+        m_lines |= BIT(irq);
+        update();
+    }
+
+    void PIC::lowerIRQ(uint8_t irq)
+    {
+        m_lines &= ~BIT(irq);
+        if (m_levelTriggered)
+            m_IRR &= ~BIT(irq);
+        update();
+    }
+
+    uint8_t PIC::acknowledge()
+    {
+        int level = resolveRequest();
+
+        // The request went away in the meantime, the 8259A answers with IRQ7
+        if (level < 0)
+            return m_vectorBase | 7;
+
+        m_IRR &= ~BIT(level);
+        if (m_levelTriggered && IS_BIT_SET(m_lines, level))
+            m_IRR |= BIT(level);
+
+        if (m_autoEOI)
+        {
+            if (m_rotateOnAutoEOI)
+                m_lowestPriority = level;
+        }
+        else
+        {
+            m_ISR |= BIT(level);
+        }
+
+        update();
+        return m_vectorBase + level;
+    }
+
+    int PIC::resolveRequest() const
+    {
+        uint8_t requests = m_IRR & ~m_IMR;
+        if (requests == 0)
+            return -1;
+
+        // Walk the levels from the highest priority down
+        for (auto i = 1; i <= 8; i++)
+        {
+            int level = (m_lowestPriority + i) & 0x7;
+
+            // Anything in service blocks its own and lower priority requests, unless special mask mode is on
+            if (IS_BIT_SET(m_ISR, level))
+            {
+                if (!m_specialMaskMode)
+                    return -1;
+                continue;
+            }
+
+            if (IS_BIT_SET(requests, level))
+                return level;
+        }
+        return -1;
+    }
+
+    int PIC::highestInService() const
+    {
+        for (auto i = 1; i <= 8; i++)
+        {
+            int level = (m_lowestPriority + i) & 0x7;
+            if (IS_BIT_SET(m_ISR, level))
+                return level;
+        }
+        return -1;
+    }
+
+    void PIC::endOfInterrupt(int level, bool rotate)
+    {
+        if (level < 0)
+            return;
+
+        m_ISR &= ~BIT(level);
+        if (rotate)
+            m_lowestPriority = level;
+        update();
+    }
+
+    void PIC::update()
+    {
+        m_pendingInterrupt = resolveRequest() >= 0;
+    }
+}
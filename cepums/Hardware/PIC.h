@@ -0,0 +1,82 @@
+#pragma once
+
+#include "IODevice.h"
+
+// IRQ lines on the XT
+#define IRQ_TIMER 0
+#define IRQ_KEYBOARD 1
+#define IRQ_HARD_DISK 5
+#define IRQ_FLOPPY 6
+
+namespace Cepums {
+
+    enum class PICInitState
+    {
+        Ready,
+        WaitingForICW2,
+        WaitingForICW3,
+        WaitingForICW4
+    };
+
+    // Intel 8259A programmable interrupt controller (single, as in the XT)
+    class PIC : public IODevice
+    {
+    public:
+        const char* getName() const override { return "PIC"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x20, 0x21 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        void serialize(std::ostream& stream) const override;
+        void restore(std::istream& stream) override;
+
+        // Port 0x20: ICW1, OCW2 and OCW3 writes, IRR/ISR reads
+        uint8_t readCommandRegister();
+        void writeCommandRegister(uint8_t value);
+
+        // Port 0x21: ICW2-4 and OCW1 (the mask) writes, mask reads
+        uint8_t readDataRegister();
+        void writeDataRegister(uint8_t value);
+
+        // IRQ lines are edge triggered unless ICW1 asks for level triggering
+        void raiseIRQ(uint8_t irq);
+        void lowerIRQ(uint8_t irq);
+        void pulseIRQ(uint8_t irq) { raiseIRQ(irq); lowerIRQ(irq); }
+
+        // True if an unmasked request would be let through right now. Kept up to date on every change so it's cheap to poll
+        bool hasPendingInterrupt() const { return m_pendingInterrupt; }
+
+        // Interrupt acknowledge: moves the highest priority request in service and returns its vector
+        uint8_t acknowledge();
+    private:
+        // Highest priority request that isn't blocked by the mask or by something in service (-1 if none)
+        int resolveRequest() const;
+
+        // Highest priority level in service (-1 if none)
+        int highestInService() const;
+
+        void endOfInterrupt(int level, bool rotate);
+        void update();
+    private:
+        uint8_t m_IRR = 0; // Interrupt request register
+        uint8_t m_ISR = 0; // In-service register
+        uint8_t m_IMR = 0; // Interrupt mask register
+        uint8_t m_lines = 0; // Current level of the IRQ inputs
+
+        // The BIOS sets these up, but they start out as the PC expects them
+        uint8_t m_vectorBase = 0x08;
+        uint8_t m_lowestPriority = 7;
+        bool m_levelTriggered = false;
+        bool m_autoEOI = false;
+        bool m_rotateOnAutoEOI = false;
+        bool m_specialMaskMode = false;
+        bool m_readISR = false;
+        bool m_poll = false;
+
+        PICInitState m_initState = PICInitState::Ready;
+        bool m_singleMode = true;
+        bool m_needICW4 = false;
+
+        bool m_pendingInterrupt = false;
+    };
+}
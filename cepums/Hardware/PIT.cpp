@@ -1,6 +1,8 @@
 #include "cepumspch.h"
 #include "PIT.h"
 
+#include "Speaker.h"
+
 #define CHANNEL_BITS(pos, byte) byte >>= pos; byte &= 0x3
 #define READ_WRITE_BITS(pos, byte) byte >>= pos; byte &= 0x3
 #define MODE_BITS(pos, byte) byte >>= pos; byte &= 0x7
@@ -12,28 +14,79 @@
 
 namespace Cepums {
 
-    uint8_t PIT::readCounter0()
+    PIT::PIT(const Scheduler& scheduler)
+        : m_scheduler(scheduler)
     {
-        DC_CORE_TRACE("PIT counter 0 reading value");
-        return readCounter(0);
     }
 
-    uint8_t PIT::readCounter1()
+    uint8_t PIT::readPort(uint16_t port)
     {
-        DC_CORE_TRACE("PIT counter 1 reading value");
-        return readCounter(1);
+        switch (port)
+        {
+        case 0x40:
+            return readCounter0();
+        case 0x41:
+            return readCounter1();
+        case 0x42:
+            return readCounter2();
+        default:
+            return IODevice::readPort(port);
+        }
     }
 
-    uint8_t PIT::readCounter2()
+    void PIT::writePort(uint16_t port, uint8_t value)
     {
-        DC_CORE_TRACE("PIT counter 2 reading value");
-        return readCounter(2);
+        switch (port)
+        {
+        case 0x40:
+            return writeCounter0(value);
+        case 0x41:
+            return writeCounter1(value);
+        case 0x42:
+            return writeCounter2(value);
+        default:
+            return writeControlRegister(value);
+        }
+    }
+
+    uint64_t PIT::getNextEventTime(uint64_t now)
+    {
+        // Right after an edge the next one is counted from that edge rather than from now, so an edge that
+        // ran late can't make us skip the one after it and IRQ0 keeps its rate
+        uint64_t clock = now / PIT_CLOCK_DIVIDER;
+        if (m_edgeClock != NO_EVENT)
+        {
+            clock = m_edgeClock;
+            m_edgeClock = NO_EVENT;
+        }
+
+        if (!m_counter[0].isInitialized)
+            return NO_EVENT;
+
+        uint64_t change = getNextOutputChange(0, clock);
+        return change == NO_EVENT ? NO_EVENT : change * PIT_CLOCK_DIVIDER;
+    }
+
+    void PIT::runEvent(uint64_t time)
+    {
+        uint64_t clock = time / PIT_CLOCK_DIVIDER;
+        bool output = getOutput(0, clock);
+
+        // IRQ0 is edge triggered, every rising edge of the output is a timer interrupt
+        if (output && !m_counter[0].output)
+            pulseIRQ();
+
+        m_counter[0].output = output;
+        m_edgeClock = clock;
     }
 
     void PIT::writeControlRegister(uint8_t value)
     {
         PARSE_SC_RW_MODE_BCD_BITS(value, selectCounterBits, readWriteBits,  modeBits, BCDbit);
 
+        if (selectCounterBits == 2 && m_speaker)
+            m_speaker->update();
+
         // Figure out which read/write mode we need to use
         CounterReadWriteMode rwMode;
         switch (readWriteBits)
@@ -44,8 +97,13 @@ namespace Cepums {
             case 0:
             case 1:
             case 2:
-                m_counter[selectCounterBits].latched = m_counter[selectCounterBits].current;
-                m_counter[selectCounterBits].isLatched = true;
+                // A second latch before the first one is read doesn't change anything
+                if (!m_counter[selectCounterBits].isLatched)
+                {
+                    m_counter[selectCounterBits].latched = getCount(selectCounterBits, getClock());
+                    m_counter[selectCounterBits].isLatched = true;
+                    m_counter[selectCounterBits].isReadingLowByte = true;
+                }
                 return;
             default:
                 VERIFY_NOT_REACHED();
@@ -122,8 +180,15 @@ namespace Cepums {
             break;
         }
         
-        // We're expecting a new initial count to be provided
-        m_counter[selectCounterBits].isInitialized = false;
+        // We're expecting a new initial count to be provided, until then the counter stands still
+        auto& counter = m_counter[selectCounterBits];
+        counter.isInitialized = false;
+        counter.isLatched = false;
+        counter.isUpdatingLowByte = true;
+        counter.isReadingLowByte = true;
+
+        // Mode 0 starts with its output low, the rest high
+        counter.output = mode != 0;
 
         DC_CORE_TRACE("PIT control register called with mode={0} for counter {1}", mode, selectCounterBits);
     }
@@ -146,117 +211,142 @@ namespace Cepums {
         writeCounter(2, value);
     }
 
-    PITState& PIT::update()
+    uint64_t PIT::getNextOutputTime(size_t counter) const
     {
-        for (auto counter = 0; counter < 3; counter++)
-        {
-            if (!m_counter[counter].isInitialized)
-                continue;
+        uint64_t change = getNextOutputChange(counter, getClock());
+        return change == NO_EVENT ? NO_EVENT : change * PIT_CLOCK_DIVIDER;
+    }
 
-            // BCD mode
-            if (m_counter[counter].isInBCDmode)
-            {
-                TODO();
-            }
+    void PIT::setGate(size_t counter, bool gate)
+    {
+        auto& state = m_counter[counter];
+        if (state.gate == gate)
+            return;
+
+        uint64_t clock = getClock();
+        if (!gate)
+            state.gateLowTime = std::max(clock, state.loadTime);
+        else if (state.mode == 2 || state.mode == 3)
+            state.loadTime = clock + 1;
+        else if (clock > state.gateLowTime)
+            state.loadTime += clock - state.gateLowTime;
+        state.gate = gate;
+    }
 
-            switch (m_counter[counter].mode)
-            {
-            case 0:
-                TODO();
-                m_counter[counter].current--;
-                // OUT0 is high when counterCurrent == 0
-                break;
+    uint64_t PIT::getCountingClock(size_t counter, uint64_t clock) const
+    {
+        auto& state = m_counter[counter];
+        return state.gate ? clock : std::min(clock, state.gateLowTime);
+    }
 
-            case 1:
-                TODO();
-                m_counter[counter].current--;
-                break;
+    uint16_t PIT::getCount(size_t counter, uint64_t clock) const
+    {
+        auto& state = m_counter[counter];
+        if (!state.isInitialized)
+            return state.initial;
 
-            case 2: // Pulsed output when reaching initial
-                if (m_counter[counter].current != 0)
-                    m_counter[counter].current--;
-                else
-                    m_counter[counter].current = m_counter[counter].initial;
-
-                // This should turn on the output every 65536 if initial is set to 0
-                if (m_counter[counter].current == m_counter[counter].initial)
-                    m_counter[counter].output = true;
-                else
-                    m_counter[counter].output = false;
-                break;
+        clock = getCountingClock(counter, clock);
 
-            case 3: // Mode 2 but square wave
-            {
-                if (m_counter[counter].current != 0)
-                    m_counter[counter].current -= 2;
-                else
-                    m_counter[counter].current = 0xFFFF;
-
-                // This should turn on the output every 65536 if initial is set to 0
-                // Real initial (to get 65536 if it's set to 0)
-                uint32_t initial = m_counter[counter].initial;
-                if (initial == 0)
-                    initial = 65536;
-
-                if (m_counter[counter].current > (initial / 2))
-                    m_counter[counter].output = true;
-                else
-                    m_counter[counter].output = false;
-                break;
-            }
-            case 4:
-                TODO();
-                m_counter[counter].current--;
-                break;
+        uint64_t elapsed = clock > state.loadTime ? clock - state.loadTime : 0;
+        uint32_t initial = state.initial ? state.initial : 65536;
+        switch (state.mode)
+        {
+        case 0:
+        case 4: // Counts down once and then keeps on wrapping around
+            return (uint16_t)(initial - elapsed);
+        case 2: // Counts down to 1 and reloads
+            return (uint16_t)(initial - elapsed % initial);
+        case 3: // Counts down by twos, once for each half of the period
+        {
+            uint32_t position = (uint32_t)(elapsed % initial);
+            uint32_t high = (initial + 1) / 2;
+            if (position < high)
+                return (uint16_t)(initial - position * 2);
+            return (uint16_t)((initial & ~1u) - (position - high) * 2);
+        }
+        default:
+            VERIFY_NOT_REACHED();
+            return 0;
+        }
+    }
 
-            case 5:
-                TODO();
-                m_counter[counter].current--;
-                break;
+    bool PIT::getOutput(size_t counter, uint64_t clock) const
+    {
+        auto& state = m_counter[counter];
+        if (!state.isInitialized)
+            return state.output;
 
-            default:
-                VERIFY_NOT_REACHED();
-                break;
-            }
+        if (!state.gate && (state.mode == 2 || state.mode == 3))
+            return true;
+        clock = getCountingClock(counter, clock);
+
+        uint64_t elapsed = clock > state.loadTime ? clock - state.loadTime : 0;
+        uint32_t initial = state.initial ? state.initial : 65536;
+        switch (state.mode)
+        {
+        case 0: // Goes high at terminal count and stays there
+            return elapsed >= initial;
+        case 2: // Low for the one clock the count is 1
+            return elapsed % initial != initial - 1;
+        case 3: // High for the first half of the period, the longer one for odd counts
+            return elapsed % initial < (initial + 1) / 2;
+        case 4: // Low for the one clock after terminal count
+            return elapsed != initial;
+        default:
+            VERIFY_NOT_REACHED();
+            return false;
+        }
+    }
+
+    uint64_t PIT::getNextOutputChange(size_t counter, uint64_t clock) const
+    {
+        auto& state = m_counter[counter];
+        // Nothing moves until the gate goes high again
+        if (!state.isInitialized || !state.gate)
+            return NO_EVENT;
+
+        uint64_t elapsed = clock > state.loadTime ? clock - state.loadTime : 0;
+        uint32_t initial = state.initial ? state.initial : 65536;
+        uint32_t position = (uint32_t)(elapsed % initial);
+        uint64_t periodStart = state.loadTime + elapsed - position;
+        switch (state.mode)
+        {
+        case 0:
+            return elapsed < initial ? state.loadTime + initial : NO_EVENT;
+        case 2:
+            return position < initial - 1 ? periodStart + initial - 1 : periodStart + initial;
+        case 3:
+        {
+            uint32_t high = (initial + 1) / 2;
+            return position < high ? periodStart + high : periodStart + initial;
+        }
+        case 4:
+            if (elapsed < initial)
+                return state.loadTime + initial;
+            return elapsed == initial ? state.loadTime + initial + 1 : NO_EVENT;
+        default:
+            VERIFY_NOT_REACHED();
+            return NO_EVENT;
         }
-        
-        // Update state
-        if (m_counter[0].output)
-            m_state.counter0output = true;
-        else
-            m_state.counter0output = false;
-
-        if (m_counter[1].output)
-            m_state.counter1output = true;
-        else
-            m_state.counter1output = false;
-
-        if (m_counter[2].output)
-            m_state.counter2output = true;
-        else
-            m_state.counter2output = false;
-
-        return m_state;
     }
 
     void PIT::writeCounter(size_t counter, uint8_t value)
     {
+        if (counter == 2 && m_speaker)
+            m_speaker->update();
+
         switch (m_counter[counter].readWriteMode)
         {
         case CounterReadWriteMode::LeastSignificantOnly:
         {
             SET8BITREGISTERLOW(m_counter[counter].initial, value);
             SET8BITREGISTERHIGH(m_counter[counter].initial, 0x00);
-            m_counter[counter].isInitialized = true;
-            m_counter[counter].current = 0xFFFF;
             break;
         }
         case CounterReadWriteMode::MostSignificantOnly:
         {
             SET8BITREGISTERLOW(m_counter[counter].initial, 0x00);
             SET8BITREGISTERHIGH(m_counter[counter].initial, value);
-            m_counter[counter].isInitialized = true;
-            m_counter[counter].current = 0xFFFF;
             break;
         }
         case CounterReadWriteMode::LeastSignificantFirstThenMostSignificant:
@@ -268,21 +358,62 @@ namespace Cepums {
             else
             {
                 SET8BITREGISTERHIGH(m_counter[counter].initial, value);
-                m_counter[counter].isInitialized = true;
-                m_counter[counter].current = 0xFFFF;
             }
             m_counter[counter].isUpdatingLowByte = !m_counter[counter].isUpdatingLowByte;
+
+            // Still waiting for the high byte
+            if (!m_counter[counter].isUpdatingLowByte)
+                return;
             break;
         }
         default:
             VERIFY_NOT_REACHED();
             break;
         }
+
+        auto& state = m_counter[counter];
+        if (state.isInBCDmode)
+            TODO();
+
+        // Modes 1 and 5 wait for a gate trigger
+        if (state.mode == 1 || state.mode == 5)
+            TODO();
+
+        // The count goes in on the next clock. Modes 2 and 3 can't count from 1
+        if ((state.mode == 2 || state.mode == 3) && state.initial == 1)
+            state.initial = 2;
+        state.loadTime = getClock() + 1;
+        state.gateLowTime = state.loadTime;
+        state.isInitialized = true;
+        state.output = getOutput(counter, state.loadTime);
     }
 
     uint8_t PIT::readCounter(size_t counter)
     {
-        TODO();
-        return 0;
+        auto& state = m_counter[counter];
+        uint16_t count = state.isLatched ? state.latched : getCount(counter, getClock());
+
+        uint8_t value;
+        switch (state.readWriteMode)
+        {
+        case CounterReadWriteMode::LeastSignificantOnly:
+            value = count & 0xFF;
+            state.isLatched = false;
+            break;
+        case CounterReadWriteMode::MostSignificantOnly:
+            value = count >> 8;
+            state.isLatched = false;
+            break;
+        case CounterReadWriteMode::LeastSignificantFirstThenMostSignificant:
+            value = state.isReadingLowByte ? count & 0xFF : count >> 8;
+            if (!state.isReadingLowByte)
+                state.isLatched = false;
+            state.isReadingLowByte = !state.isReadingLowByte;
+            break;
+        default:
+            VERIFY_NOT_REACHED();
+            return 0;
+        }
+        return value;
     }
 }
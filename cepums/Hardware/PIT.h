@@ -1,7 +1,12 @@
 #pragma once
 
+#include "IODevice.h"
+#include "Scheduler.h"
+
 namespace Cepums {
 
+    class Speaker;
+
     enum class CounterReadWriteMode
     {
         LeastSignificantOnly,
@@ -9,50 +14,84 @@ namespace Cepums {
         LeastSignificantFirstThenMostSignificant
     };
 
-    struct PITState
-    {
-        bool counter0output = false;
-        bool counter1output = false;
-        bool counter2output = false;
-    };
-
     struct PITCounter
     {
-        uint16_t current;
-        uint16_t latched; // Basically a copy
-        uint16_t initial;
-        bool output = false; // TODO: Do something with the output
+        uint16_t initial = 0; // 0 counts 65536
+        uint64_t loadTime = 0; // PIT clock the count was loaded on, the count is worked out from it when it's needed
+        uint16_t latched = 0;
+        bool output = false; // As of the last output event
+        bool gate = true; // Only counter 2's can be changed, through port 61h
+        uint64_t gateLowTime = 0; // PIT clock the gate went low on, counting is held from then on
         bool isInitialized = false;
         bool isLatched = false;
-        bool isHighLatchedByteRead = false;
-        bool isLowLatchedByteRead = false;
+        bool isReadingLowByte = true; // Used for CounterReadWriteMode::LeastSignificantFirstThenMostSignificant
         bool isInBCDmode = false;
         bool isUpdatingLowByte = true; // Used for CounterReadWriteMode::LeastSignificantFirstThenMostSignificant
         int mode = -1;
-        CounterReadWriteMode readWriteMode;
+        CounterReadWriteMode readWriteMode = CounterReadWriteMode::LeastSignificantFirstThenMostSignificant;
     };
 
-    class PIT
+    // Nothing is stepped per clock: every counter remembers when it was loaded, and its count and output are
+    // worked out from the time that has passed whenever they're read. Only the output edges of counter 0 are
+    // scheduled as events, as it's the only output with something connected to it that can't wait to be asked
+    class PIT : public IODevice
     {
     public:
-        uint8_t readCounter0();
-        uint8_t readCounter1();
-        uint8_t readCounter2();
+        PIT(const Scheduler& scheduler);
+
+        const char* getName() const override { return "PIT"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x40, 0x43 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        // Counter 0's next output edge, its rising edges raise IRQ0
+        uint64_t getNextEventTime(uint64_t now) override;
+        void runEvent(uint64_t time) override;
+
+        uint8_t readCounter0() { return readCounter(0); }
+        uint8_t readCounter1() { return readCounter(1); }
+        uint8_t readCounter2() { return readCounter(2); }
 
         void writeControlRegister(uint8_t value);
         void writeCounter0(uint8_t value);
         void writeCounter1(uint8_t value);
         void writeCounter2(uint8_t value);
 
-        PITState& update();
+        // Counting is held while the gate is low. In modes 2 and 3 the output is also forced high, and the count
+        // starts over on the rising edge
+        void setGate(size_t counter, bool gate);
+
+        // Counter 2's output drives the speaker, which has to catch up before the counter is changed
+        void connectSpeaker(Speaker& speaker) { m_speaker = &speaker; }
+
+        // A counter's output right now, and the master clock tick it next changes on (NO_EVENT if it won't)
+        bool getOutput(size_t counter) const { return getOutput(counter, getClock()); }
+        uint64_t getNextOutputTime(size_t counter) const;
+
+        // The output and the next PIT clock it changes on (NO_EVENT if it won't) at a PIT clock, as long as
+        // the counter isn't changed in between
+        bool getOutput(size_t counter, uint64_t clock) const;
+        uint64_t getNextOutputChange(size_t counter, uint64_t clock) const;
     private:
         void writeCounter(size_t counter, uint8_t value);
         uint8_t readCounter(size_t counter);
+
+        uint64_t getClock() const { return m_scheduler.now() / PIT_CLOCK_DIVIDER; }
+
+        // The last PIT clock the counter counted on, which stays behind while the gate is low
+        uint64_t getCountingClock(size_t counter, uint64_t clock) const;
+
+        uint16_t getCount(size_t counter, uint64_t clock) const;
     private:
-        PITState m_state;
+        const Scheduler& m_scheduler;
+        Speaker* m_speaker = nullptr;
+
         // Counter 0: Counter divisor
         // Counter 1: RAM refresh counter
         // Counter 2: Cassette  and speaker
         PITCounter m_counter[3];
+
+        // PIT clock of the counter 0 edge that has just run, until the next one is scheduled from it
+        uint64_t m_edgeClock = NO_EVENT;
     };
 }
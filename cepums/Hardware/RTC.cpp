@@ -43,6 +43,100 @@ namespace Cepums {
         DateCentury = 0x32,
     };
 
+    uint8_t RTC::readPort(uint16_t port)
+    {
+        if (port == 0x71)
+            return readDataPort();
+        return IODevice::readPort(port);
+    }
+
+    void RTC::writePort(uint16_t port, uint8_t value)
+    {
+        if (port == 0x70)
+            return writeIndexRegister(value);
+        writeDataPort(value);
+    }
+
+    void RTC::setFloppyDrives(uint8_t drive0Type, uint8_t drive1Type, unsigned int driveCount)
+    {
+        m_floppyDiskTypes = drive0Type << 4 | (drive1Type & 0xF);
+
+        // Bit 0 says there are floppy drives, bits 6-7 how many past the first
+        m_installedEquipment &= 0x3E;
+        if (driveCount)
+            m_installedEquipment |= 0x01 | (driveCount - 1) << 6;
+
+        updateChecksum();
+    }
+
+    void RTC::updateChecksum()
+    {
+        // The sum of every byte from 10h to 2Dh, the ones without a member are always 0
+        uint16_t checksum = m_floppyDiskTypes + m_systemConfigurationSettings + m_hardDiskTypes + m_typematicParameters
+            + m_installedEquipment + m_baseMemoryLSB + m_baseMemoryMSB + m_extendedMemoryLSB + m_extendedMemoryMSB
+            + m_hardDisk0Type + m_hardDisk1Type + m_systemOperationalFlags;
+        m_checksumMSB = checksum >> 8;
+        m_checksumLSB = checksum & 0xFF;
+    }
+
+    void RTC::serialize(std::ostream& stream) const
+    {
+        writeState(stream, m_seconds);
+        writeState(stream, m_minutes);
+        writeState(stream, m_hours);
+        writeState(stream, m_day);
+        writeState(stream, m_month);
+        writeState(stream, m_year);
+        writeState(stream, m_century);
+        writeState(stream, m_statusRegisterA);
+        writeState(stream, m_statusRegisterB);
+        writeState(stream, m_statusRegisterC);
+        writeState(stream, m_floppyDiskTypes);
+        writeState(stream, m_systemConfigurationSettings);
+        writeState(stream, m_hardDiskTypes);
+        writeState(stream, m_typematicParameters);
+        writeState(stream, m_installedEquipment);
+        writeState(stream, m_baseMemoryLSB);
+        writeState(stream, m_baseMemoryMSB);
+        writeState(stream, m_extendedMemoryLSB);
+        writeState(stream, m_extendedMemoryMSB);
+        writeState(stream, m_hardDisk0Type);
+        writeState(stream, m_hardDisk1Type);
+        writeState(stream, m_systemOperationalFlags);
+        writeState(stream, m_checksumLSB);
+        writeState(stream, m_checksumMSB);
+        writeState(stream, m_mode);
+    }
+
+    void RTC::restore(std::istream& stream)
+    {
+        readState(stream, m_seconds);
+        readState(stream, m_minutes);
+        readState(stream, m_hours);
+        readState(stream, m_day);
+        readState(stream, m_month);
+        readState(stream, m_year);
+        readState(stream, m_century);
+        readState(stream, m_statusRegisterA);
+        readState(stream, m_statusRegisterB);
+        readState(stream, m_statusRegisterC);
+        readState(stream, m_floppyDiskTypes);
+        readState(stream, m_systemConfigurationSettings);
+        readState(stream, m_hardDiskTypes);
+        readState(stream, m_typematicParameters);
+        readState(stream, m_installedEquipment);
+        readState(stream, m_baseMemoryLSB);
+        readState(stream, m_baseMemoryMSB);
+        readState(stream, m_extendedMemoryLSB);
+        readState(stream, m_extendedMemoryMSB);
+        readState(stream, m_hardDisk0Type);
+        readState(stream, m_hardDisk1Type);
+        readState(stream, m_systemOperationalFlags);
+        readState(stream, m_checksumLSB);
+        readState(stream, m_checksumMSB);
+        readState(stream, m_mode);
+    }
+
     void RTC::writeDataPort(uint8_t value)
     {
         switch (m_mode)
@@ -182,7 +276,7 @@ namespace Cepums {
             byte = 0x80;
             break;
         case FloppyDiskTypes:
-            byte = m_floppyDiskTypes; // Drive 0: 1.44MB | Drive 1: None
+            byte = m_floppyDiskTypes;
             break;
         case SystemConfigurationSettings:
             byte = m_systemConfigurationSettings;
@@ -247,6 +341,10 @@ namespace Cepums {
             TODO();
             break;
         default:
+            // The rest of the checksummed bytes aren't used
+            if (m_mode > Unused5 && m_mode < SystemOperationalFlags)
+                break;
+
             // Uh oh
             DC_CORE_ERROR("Unhandled mode: {0:X} :(", m_mode);
             TODO();
@@ -1,13 +1,28 @@
 #pragma once
 
+#include "IODevice.h"
+
 namespace Cepums {
 
-    class RTC
+    class RTC : public IODevice
     {
     public:
+        const char* getName() const override { return "RTC"; }
+        std::vector<PortRange> getPortRanges() const override { return { { 0x70, 0x71 } }; }
+        uint8_t readPort(uint16_t port) override;
+        void writePort(uint16_t port, uint8_t value) override;
+
+        void serialize(std::ostream& stream) const override;
+        void restore(std::istream& stream) override;
+
         void writeIndexRegister(uint8_t value) { m_mode = value; }
         void writeDataPort(uint8_t value);
         uint8_t readDataPort();
+
+        // Drive types for the first two floppy drives (0 for none) and how many drives there are in total
+        void setFloppyDrives(uint8_t drive0Type, uint8_t drive1Type, unsigned int driveCount);
+    private:
+        void updateChecksum();
     private:
         // 12:48:20
         uint8_t m_seconds = 0x20;
@@ -24,7 +39,7 @@ namespace Cepums {
         uint8_t m_statusRegisterB = 4; // Enable DST and 24hr clock
         uint8_t m_statusRegisterC = 0; // System status
 
-        uint8_t m_floppyDiskTypes = 0x40; // Drive 0: 1.44MB | Drive 1: None
+        uint8_t m_floppyDiskTypes = 0x40; // Drive 0: 1.44MB | Drive 1: None, until the drives are set up
         uint8_t m_systemConfigurationSettings = 0x8B; // A bunch of things
         uint8_t m_hardDiskTypes = 0x00; // No hard disks
         uint8_t m_typematicParameters = 0x00; // No typematic stuff
@@ -37,8 +52,8 @@ namespace Cepums {
         uint8_t m_hardDisk1Type = 0x00; // No hard disk 1
 
         uint8_t m_systemOperationalFlags = 0x74; // A bunch of stuff
-        uint8_t m_checksumLSB = 0x0E;
-        uint8_t m_checksumMSB = 0x02;
+        uint8_t m_checksumLSB = 0xFE;
+        uint8_t m_checksumMSB = 0x01;
 
         int m_mode = -1;
     };
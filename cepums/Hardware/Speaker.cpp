@@ -0,0 +1,256 @@
+#include "cepumspch.h"
+#include "Speaker.h"
+
+#include "PIT.h"
+
+#include <cmath>
+
+// How often the samples are brought up to date while nothing changes the signal
+#define SPEAKER_UPDATE_INTERVAL microsecondsToMasterTicks(1000)
+
+// Everything above this is filtered out before downsampling
+#define SPEAKER_FILTER_CUTOFF 18000.0
+
+// Cuts below about 40 Hz, like the capacitor in front of a real speaker
+#define SPEAKER_DC_BLOCKER_POLE 0.995f
+
+#define SPEAKER_VOLUME 0.5f
+
+// A live audio device is kept at most 100 ms behind
+#define SPEAKER_MAX_LATENCY (SPEAKER_SAMPLE_RATE / 10)
+
+// The WAV header counts the data in bytes with 32 bits, that's about 12 hours
+#define SPEAKER_MAX_RECORDED_SAMPLES ((UINT32_MAX - 36) / sizeof(int16_t))
+
+namespace Cepums {
+
+    static void writeWAVHeader(std::ostream& stream, uint32_t sampleCount)
+    {
+        auto write16 = [&](uint16_t value) { stream.put((char)value).put((char)(value >> 8)); };
+        auto write32 = [&](uint32_t value) { write16((uint16_t)value); write16((uint16_t)(value >> 16)); };
+
+        // 16-bit mono PCM
+        uint32_t dataSize = sampleCount * sizeof(int16_t);
+        stream.write("RIFF", 4);
+        write32(36 + dataSize);
+        stream.write("WAVEfmt ", 8);
+        write32(16);
+        write16(1);
+        write16(1);
+        write32(SPEAKER_SAMPLE_RATE);
+        write32(SPEAKER_SAMPLE_RATE * sizeof(int16_t));
+        write16(sizeof(int16_t));
+        write16(16);
+        stream.write("data", 4);
+        write32(dataSize);
+    }
+
+    Speaker::Speaker(const Scheduler& scheduler, PIT& pit)
+        : m_scheduler(scheduler)
+        , m_pit(pit)
+    {
+        // Blackman windowed sinc at the oversampled rate, normalized to unity gain
+        const double pi = 3.14159265358979323846;
+        double cutoff = SPEAKER_FILTER_CUTOFF / (SPEAKER_SAMPLE_RATE * SPEAKER_OVERSAMPLING);
+        double sum = 0;
+        double coefficients[SPEAKER_FILTER_TAPS];
+        for (size_t i = 0; i < SPEAKER_FILTER_TAPS; i++)
+        {
+            double x = i - (SPEAKER_FILTER_TAPS - 1) / 2.0;
+            double sinc = x == 0 ? 2 * cutoff : std::sin(2 * pi * cutoff * x) / (pi * x);
+            double window = 0.42 - 0.5 * std::cos(2 * pi * i / (SPEAKER_FILTER_TAPS - 1)) + 0.08 * std::cos(4 * pi * i / (SPEAKER_FILTER_TAPS - 1));
+            coefficients[i] = sinc * window;
+            sum += coefficients[i];
+        }
+        for (size_t i = 0; i < SPEAKER_FILTER_TAPS; i++)
+            m_coefficients[i] = (float)(coefficients[i] / sum);
+
+        m_sampleEnd = getNextSampleLength();
+    }
+
+    void Speaker::setControl(uint8_t value)
+    {
+        update();
+        m_control = value & 0x3;
+        m_pit.setGate(2, IS_BIT_SET(value, 0));
+    }
+
+    void Speaker::update()
+    {
+        render(m_scheduler.now());
+    }
+
+    uint64_t Speaker::getNextEventTime(uint64_t now)
+    {
+        // Nobody's listening, so it's only rendered when the signal changes. Otherwise this would cut every idle skip short
+        if (!m_outputEnabled)
+            return NO_EVENT;
+        return now + SPEAKER_UPDATE_INTERVAL;
+    }
+
+    void Speaker::runEvent(uint64_t time)
+    {
+        render(time);
+    }
+
+    bool Speaker::startRecording(const std::string& path)
+    {
+        m_recording.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_recording)
+        {
+            DC_CORE_CRITICAL("[Speaker]: Can't open audio dump '{0}'", path);
+            return false;
+        }
+
+        // The header is filled in once the length is known
+        writeWAVHeader(m_recording, 0);
+        m_recordedSamples = 0;
+        m_outputEnabled = true;
+        return true;
+    }
+
+    void Speaker::stopRecording()
+    {
+        if (!m_recording.is_open())
+            return;
+
+        update();
+        m_recording.seekp(0);
+        writeWAVHeader(m_recording, m_recordedSamples);
+        m_recording.close();
+        DC_CORE_INFO("[Speaker]: Recorded {0:.3f} seconds of audio", (double)m_recordedSamples / SPEAKER_SAMPLE_RATE);
+    }
+
+    size_t Speaker::readSamples(int16_t* samples, size_t count)
+    {
+        size_t read = 0;
+        while (read < count && m_samples.pop(samples[read]))
+            read++;
+        return read;
+    }
+
+    void Speaker::playSamples(int16_t* samples, size_t count)
+    {
+        // Fast-forward, or the host's audio clock running a little slower than its timer
+        int16_t dropped;
+        while (m_samples.size() > SPEAKER_MAX_LATENCY + count)
+            m_samples.pop(dropped);
+
+        size_t read = readSamples(samples, count);
+        if (read)
+            m_lastPlayed = samples[read - 1];
+        for (size_t i = read; i < count; i++)
+            samples[i] = m_lastPlayed;
+    }
+
+    void Speaker::render(uint64_t time)
+    {
+        // Nobody's listening, just keep up with the time so there's no backlog once somebody is
+        if (!m_outputEnabled)
+        {
+            if (time > m_renderedTime)
+            {
+                m_renderedTime = time;
+                m_sampleStart = time;
+                m_sampleEnd = time + getNextSampleLength();
+                m_highTicks = 0;
+            }
+            return;
+        }
+
+        while (m_renderedTime < time)
+        {
+            // Add up how long the signal is high within the sample
+            uint64_t end = std::min(time, m_sampleEnd);
+            while (m_renderedTime < end)
+            {
+                uint64_t change;
+                bool level = getLevel(m_renderedTime, change);
+                uint64_t until = std::min(end, change);
+                if (level)
+                    m_highTicks += until - m_renderedTime;
+                m_renderedTime = until;
+            }
+
+            if (m_renderedTime == m_sampleEnd)
+            {
+                pushOversample((float)m_highTicks / (m_sampleEnd - m_sampleStart));
+                m_highTicks = 0;
+                m_sampleStart = m_sampleEnd;
+                m_sampleEnd += getNextSampleLength();
+            }
+        }
+    }
+
+    bool Speaker::getLevel(uint64_t time, uint64_t& change) const
+    {
+        // Only changes with a port 61h write, which renders first
+        if (IS_BIT_NOT_SET(m_control, 1))
+        {
+            change = NO_EVENT;
+            return false;
+        }
+
+        uint64_t clock = time / PIT_CLOCK_DIVIDER;
+        uint64_t next = m_pit.getNextOutputChange(2, clock);
+        change = next == NO_EVENT ? NO_EVENT : next * PIT_CLOCK_DIVIDER;
+        return m_pit.getOutput(2, clock);
+    }
+
+    uint64_t Speaker::getNextSampleLength()
+    {
+        const uint64_t divisor = (uint64_t)MASTER_CLOCK_DENOMINATOR * SPEAKER_SAMPLE_RATE * SPEAKER_OVERSAMPLING;
+        m_samplePhase += MASTER_CLOCK_NUMERATOR;
+        uint64_t length = m_samplePhase / divisor;
+        m_samplePhase %= divisor;
+        return length;
+    }
+
+    void Speaker::pushOversample(float value)
+    {
+        m_history[m_historyPosition] = value;
+        m_history[m_historyPosition + SPEAKER_FILTER_TAPS] = value;
+        m_historyPosition = (m_historyPosition + 1) % SPEAKER_FILTER_TAPS;
+
+        if (++m_decimationPhase < SPEAKER_OVERSAMPLING)
+            return;
+        m_decimationPhase = 0;
+
+        // Eight independent sums instead of one, so the compiler can keep them in a vector register
+        const float* window = &m_history[m_historyPosition];
+        float sums[8] = {};
+        for (size_t i = 0; i < SPEAKER_FILTER_TAPS; i += 8)
+        {
+            for (size_t lane = 0; lane < 8; lane++)
+                sums[lane] += window[i + lane] * m_coefficients[i + lane];
+        }
+        float filtered = ((sums[0] + sums[4]) + (sums[1] + sums[5])) + ((sums[2] + sums[6]) + (sums[3] + sums[7]));
+
+        float output = filtered - m_lastFiltered + SPEAKER_DC_BLOCKER_POLE * m_lastOutput;
+        m_lastFiltered = filtered;
+        m_lastOutput = output;
+
+        long sample = std::lround(output * SPEAKER_VOLUME * INT16_MAX);
+        sample = std::clamp(sample, (long)INT16_MIN, (long)INT16_MAX);
+
+        if (m_recording.is_open())
+        {
+            if (m_recordedSamples == SPEAKER_MAX_RECORDED_SAMPLES)
+            {
+                if (!m_reportedOverflow)
+                    DC_CORE_WARN("[Speaker]: The audio dump is as long as a WAV file can be, the rest is left out");
+                m_reportedOverflow = true;
+                return;
+            }
+            m_recording.put((char)sample).put((char)(sample >> 8));
+            m_recordedSamples++;
+            return;
+        }
+
+        if (!m_samples.push((int16_t)sample) && !m_reportedOverflow)
+        {
+            DC_CORE_WARN("[Speaker]: The audio output can't keep up, samples are being dropped");
+            m_reportedOverflow = true;
+        }
+    }
+}
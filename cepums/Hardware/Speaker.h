@@ -0,0 +1,104 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+
+#include "IODevice.h"
+#include "SPSCQueue.h"
+
+#define SPEAKER_SAMPLE_RATE 48000
+
+// The signal is box filtered at this multiple of the sample rate first, then low-pass filtered down to it
+#define SPEAKER_OVERSAMPLING 4
+
+// A multiple of 8, so the filter loop splits into whole vectors
+#define SPEAKER_FILTER_TAPS 96
+
+// About 1.4 seconds of samples between the emulation and the audio output
+#define SPEAKER_QUEUE_SIZE 65536
+
+namespace Cepums {
+
+    class PIT;
+
+    // The PC speaker plays PIT counter 2's output while bit 1 of port 61h is set, and bit 0 is the counter's gate.
+    // The 1-bit signal is integrated exactly between its edges in emulated time, band-limited and downsampled
+    // to SPEAKER_SAMPLE_RATE, and left in a queue for the audio thread. The emulation never waits for it
+    class Speaker : public IODevice
+    {
+    public:
+        Speaker(const Scheduler& scheduler, PIT& pit);
+
+        const char* getName() const override { return "Speaker"; }
+
+        // Port 61h bits 0 and 1
+        uint8_t getControl() const { return m_control; }
+        void setControl(uint8_t value);
+
+        // Renders the signal up to now. Has to be called before anything that changes it
+        void update();
+
+        // Renders regularly while something takes the samples, so they keep flowing while the signal doesn't change.
+        // That also holds fast-forward back to the speed a recording can be written at
+        uint64_t getNextEventTime(uint64_t now) override;
+        void runEvent(uint64_t time) override;
+
+        // Nothing is rendered until something takes the samples. Has to be set before the processing thread starts
+        void setOutputEnabled(bool enabled) { m_outputEnabled = enabled; }
+
+        // Writes every sample to a WAV file instead of the queue, so none are dropped however fast the emulation runs.
+        // Started before the processing thread, and stopped after it's done to render the rest and finish the file
+        bool startRecording(const std::string& path);
+        void stopRecording();
+
+        // Audio thread side. Takes up to count samples and returns how many there were
+        size_t readSamples(int16_t* samples, size_t count);
+
+        // For a live audio device: always fills the whole buffer, holding the last sample when the emulation is
+        // behind and dropping what has piled up beyond the latency target when it's ahead
+        void playSamples(int16_t* samples, size_t count);
+    private:
+        void render(uint64_t time);
+
+        // The signal at a master clock tick, and the tick it can change on next (NO_EVENT if it won't)
+        bool getLevel(uint64_t time, uint64_t& change) const;
+
+        // Master clock ticks the next oversampled sample covers, the remainder carries over so the rate stays exact
+        uint64_t getNextSampleLength();
+
+        void pushOversample(float value);
+    private:
+        const Scheduler& m_scheduler;
+        PIT& m_pit;
+
+        uint8_t m_control = 0;
+        bool m_outputEnabled = false;
+
+        // The oversampled sample being integrated
+        uint64_t m_renderedTime = 0;
+        uint64_t m_sampleStart = 0;
+        uint64_t m_sampleEnd = 0;
+        uint64_t m_samplePhase = 0;
+        uint64_t m_highTicks = 0;
+
+        // The oversampled history is stored twice, so the newest SPEAKER_FILTER_TAPS of it are always contiguous
+        alignas(32) float m_history[SPEAKER_FILTER_TAPS * 2] = {};
+        alignas(32) float m_coefficients[SPEAKER_FILTER_TAPS];
+        size_t m_historyPosition = 0;
+        unsigned int m_decimationPhase = 0;
+
+        // DC blocker, the speaker's idle level is silence
+        float m_lastFiltered = 0;
+        float m_lastOutput = 0;
+
+        bool m_reportedOverflow = false;
+
+        std::ofstream m_recording;
+        uint32_t m_recordedSamples = 0;
+
+        SPSCQueue<int16_t, SPEAKER_QUEUE_SIZE> m_samples;
+
+        // Audio thread only
+        int16_t m_lastPlayed = 0;
+    };
+}
@@ -0,0 +1,243 @@
+#include "cepumspch.h"
+#include "Headless.h"
+
+#include "Hardware/MDA.h"
+
+#include <deque>
+#include <thread>
+
+namespace Cepums {
+
+    struct CharacterToScancode
+    {
+        char character;
+        SDL_Scancode scancode;
+        bool shift;
+    };
+
+    // US layout, letters and digits are handled separately
+    const CharacterToScancode s_characterToScancode[] = {
+        { ' ',  SDL_SCANCODE_SPACE,         false },
+        { '\n', SDL_SCANCODE_RETURN,        false },
+        { '\t', SDL_SCANCODE_TAB,           false },
+        { '\b', SDL_SCANCODE_BACKSPACE,     false },
+        { 0x1B, SDL_SCANCODE_ESCAPE,        false },
+        { '-',  SDL_SCANCODE_MINUS,         false },
+        { '_',  SDL_SCANCODE_MINUS,         true  },
+        { '=',  SDL_SCANCODE_EQUALS,        false },
+        { '+',  SDL_SCANCODE_EQUALS,        true  },
+        { '[',  SDL_SCANCODE_LEFTBRACKET,   false },
+        { '{',  SDL_SCANCODE_LEFTBRACKET,   true  },
+        { ']',  SDL_SCANCODE_RIGHTBRACKET,  false },
+        { '}',  SDL_SCANCODE_RIGHTBRACKET,  true  },
+        { '\\', SDL_SCANCODE_BACKSLASH,     false },
+        { '|',  SDL_SCANCODE_BACKSLASH,     true  },
+        { ';',  SDL_SCANCODE_SEMICOLON,     false },
+        { ':',  SDL_SCANCODE_SEMICOLON,     true  },
+        { '\'', SDL_SCANCODE_APOSTROPHE,    false },
+        { '"',  SDL_SCANCODE_APOSTROPHE,    true  },
+        { '`',  SDL_SCANCODE_GRAVE,         false },
+        { '~',  SDL_SCANCODE_GRAVE,         true  },
+        { ',',  SDL_SCANCODE_COMMA,         false },
+        { '<',  SDL_SCANCODE_COMMA,         true  },
+        { '.',  SDL_SCANCODE_PERIOD,        false },
+        { '>',  SDL_SCANCODE_PERIOD,        true  },
+        { '/',  SDL_SCANCODE_SLASH,         false },
+        { '?',  SDL_SCANCODE_SLASH,         true  },
+        { '!',  SDL_SCANCODE_1,             true  },
+        { '@',  SDL_SCANCODE_2,             true  },
+        { '#',  SDL_SCANCODE_3,             true  },
+        { '$',  SDL_SCANCODE_4,             true  },
+        { '%',  SDL_SCANCODE_5,             true  },
+        { '^',  SDL_SCANCODE_6,             true  },
+        { '&',  SDL_SCANCODE_7,             true  },
+        { '*',  SDL_SCANCODE_8,             true  },
+        { '(',  SDL_SCANCODE_9,             true  },
+        { ')',  SDL_SCANCODE_0,             true  },
+    };
+
+    static bool characterToScancode(char character, SDL_Scancode& scancode, bool& shift)
+    {
+        shift = false;
+
+        if (character >= 'a' && character <= 'z')
+        {
+            scancode = (SDL_Scancode)(SDL_SCANCODE_A + (character - 'a'));
+            return true;
+        }
+
+        if (character >= 'A' && character <= 'Z')
+        {
+            scancode = (SDL_Scancode)(SDL_SCANCODE_A + (character - 'A'));
+            shift = true;
+            return true;
+        }
+
+        // SDL puts 0 after 9
+        if (character >= '1' && character <= '9')
+        {
+            scancode = (SDL_Scancode)(SDL_SCANCODE_1 + (character - '1'));
+            return true;
+        }
+        if (character == '0')
+        {
+            scancode = SDL_SCANCODE_0;
+            return true;
+        }
+
+        for (auto& entry : s_characterToScancode)
+        {
+            if (entry.character == character)
+            {
+                scancode = entry.scancode;
+                shift = entry.shift;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void writeScreenDumps(const Options& options, MDA& adapter, const std::vector<uint8_t>& font)
+    {
+        auto mda = adapter.getVideoRAM();
+
+        if (!options.screenDump.empty())
+        {
+            std::string text = MDAToText(mda);
+            if (options.screenDump == "-")
+            {
+                std::cout << text << std::flush;
+            }
+            else
+            {
+                std::ofstream textStream(options.screenDump, std::ios::out | std::ios::trunc);
+                textStream << text;
+            }
+        }
+
+        if (!options.framebufferDump.empty() && !font.empty())
+        {
+            std::vector<uint8_t> framebuffer;
+            rasterizeMDA(mda, font, framebuffer, true);
+
+            std::ofstream imageStream(options.framebufferDump, std::ios::out | std::ios::binary | std::ios::trunc);
+            imageStream << "P6\n" << MDA_SCREEN_WIDTH << " " << MDA_SCREEN_HEIGHT << "\n255\n";
+            imageStream.write((const char*)framebuffer.data(), framebuffer.size());
+        }
+    }
+
+    // Characters waiting to be typed
+    struct KeyInput
+    {
+        std::mutex mutex;
+        std::deque<char> characters;
+    };
+
+    int runHeadless(const Options& options, IOManager& ioManager, std::atomic<bool>& shouldExecute)
+    {
+        using Clock = std::chrono::steady_clock;
+
+        // The font is only needed for framebuffer dumps
+        std::vector<uint8_t> font;
+        if (!options.framebufferDump.empty() && !loadMDAFont(font))
+            DC_CORE_ERROR("[Headless]: No font available, framebuffer dumps are disabled");
+
+        // Keyboard input. The stdin reader can outlive this function, so it holds on to the queue itself
+        auto input = std::make_shared<KeyInput>();
+        if (options.keyScript == "-")
+        {
+            // Reading stdin blocks, so it's left running on its own
+            std::thread([input] {
+                int character;
+                while ((character = std::getchar()) != EOF)
+                {
+                    std::lock_guard<std::mutex> guard(input->mutex);
+                    input->characters.push_back((char)character);
+                }
+            }).detach();
+        }
+        else if (!options.keyScript.empty())
+        {
+            std::ifstream scriptStream(options.keyScript, std::ios::in | std::ios::binary);
+            if (!scriptStream)
+            {
+                DC_CORE_CRITICAL("[Headless]: Can't open key script '{0}'", options.keyScript);
+                return 1;
+            }
+            input->characters.assign(std::istreambuf_iterator<char>(scriptStream), std::istreambuf_iterator<char>());
+        }
+
+        DC_CORE_INFO("[Headless]: Running without a window");
+
+        auto start = Clock::now();
+        auto nextDump = start;
+        auto nextKey = start;
+        auto keyDelay = std::chrono::milliseconds(options.keyDelay);
+
+        // Keys are pressed and released in separate steps so the guest sees both
+        bool keyHeld = false;
+        bool shiftHeld = false;
+        SDL_Scancode heldScancode = SDL_SCANCODE_UNKNOWN;
+
+        while (shouldExecute)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            auto now = Clock::now();
+
+            if (now >= nextKey)
+            {
+                if (keyHeld)
+                {
+                    ioManager.onKeyRelease(heldScancode);
+                    if (shiftHeld)
+                        ioManager.onKeyRelease(SDL_SCANCODE_LSHIFT);
+                    keyHeld = false;
+                    nextKey = now + keyDelay;
+                }
+                else
+                {
+                    char character = 0;
+                    bool hasCharacter = false;
+                    {
+                        std::lock_guard<std::mutex> guard(input->mutex);
+                        if (!input->characters.empty())
+                        {
+                            character = input->characters.front();
+                            input->characters.pop_front();
+                            hasCharacter = true;
+                        }
+                    }
+
+                    if (hasCharacter)
+                    {
+                        if (characterToScancode(character, heldScancode, shiftHeld))
+                        {
+                            if (shiftHeld)
+                                ioManager.onKeyPress(SDL_SCANCODE_LSHIFT);
+                            ioManager.onKeyPress(heldScancode);
+                            keyHeld = true;
+                            nextKey = now + keyDelay;
+                        }
+                        else
+                        {
+                            DC_CORE_WARN("[Headless]: No key for character 0x{0:X}, skipping", (uint8_t)character);
+                        }
+                    }
+                }
+            }
+
+            if (options.dumpInterval != 0 && now >= nextDump)
+            {
+                writeScreenDumps(options, ioManager.getMDA(), font);
+                nextDump = now + std::chrono::milliseconds(options.dumpInterval);
+            }
+
+            if (options.runFor != 0 && now - start >= std::chrono::seconds(options.runFor))
+                shouldExecute = false;
+        }
+
+        // Always leave the final screen behind
+        writeScreenDumps(options, ioManager.getMDA(), font);
+        return 0;
+    }
+}
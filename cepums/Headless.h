@@ -0,0 +1,13 @@
+#pragma once
+
+#include <atomic>
+
+#include "IOManager.h"
+#include "Options.h"
+
+namespace Cepums {
+
+    // Runs the machine without a window. Keyboard input comes from a script file (or stdin) and
+    // the screen is written out as text and optionally as a PPM framebuffer
+    int runHeadless(const Options& options, IOManager& ioManager, std::atomic<bool>& shouldExecute);
+}
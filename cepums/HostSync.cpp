@@ -0,0 +1,87 @@
+#include "cepumspch.h"
+#include "HostSync.h"
+
+#include "Clock.h"
+
+#include <thread>
+
+#include <SDL.h>
+
+namespace Cepums {
+
+    HostSync::HostSync(const Options& options)
+        : m_frequency(SDL_GetPerformanceFrequency())
+        , m_sliceTicks(microsecondsToMasterTicks(options.syncSlice))
+        , m_spinTime(options.syncSpin * m_frequency / 1000000)
+        , m_reportInterval(options.statsInterval * m_frequency)
+    {
+        // A slice has to contain at least one instruction
+        if (m_sliceTicks < CPU_CLOCK_DIVIDER)
+            m_sliceTicks = CPU_CLOCK_DIVIDER;
+    }
+
+    void HostSync::reset(uint64_t emulatedTime)
+    {
+        m_anchorHostTime = SDL_GetPerformanceCounter();
+        m_anchorTicks = emulatedTime;
+        m_lastReport = m_anchorHostTime;
+    }
+
+    uint64_t HostSync::hostToEmulatedTime(uint64_t hostTime) const
+    {
+        if (hostTime < m_anchorHostTime)
+            return m_anchorTicks;
+        return m_anchorTicks + hostToMasterTicks(hostTime - m_anchorHostTime, m_frequency);
+    }
+
+    void HostSync::waitUntil(uint64_t emulatedTime)
+    {
+        uint64_t deadline = m_anchorHostTime + masterTicksToHost(emulatedTime - m_anchorTicks, m_frequency);
+        uint64_t now = SDL_GetPerformanceCounter();
+        m_slices++;
+
+        if (now >= deadline)
+        {
+            // We're behind, so the next slice runs right away and catches up
+            m_lateSlices++;
+            m_lag = now - deadline;
+            m_maxLag = std::max(m_maxLag, m_lag);
+        }
+        else
+        {
+            m_lag = 0;
+
+            // Sleep through most of the wait...
+            if (deadline - now > m_spinTime)
+            {
+                uint64_t sleepTime = deadline - now - m_spinTime;
+                std::this_thread::sleep_for(std::chrono::microseconds(sleepTime * 1000000 / m_frequency));
+            }
+
+            // ...and spin for the rest
+            uint64_t spinStart = SDL_GetPerformanceCounter();
+            m_slept += spinStart - now;
+            now = spinStart;
+            while (now < deadline)
+                now = SDL_GetPerformanceCounter();
+        }
+
+        report(now);
+    }
+
+    void HostSync::report(uint64_t now)
+    {
+        if (m_reportInterval == 0 || now - m_lastReport < m_reportInterval)
+            return;
+
+        double elapsed = (double)(now - m_lastReport);
+        DC_CORE_INFO("[HostSync]: {0:.2f} ms behind the host clock (worst {1:.2f} ms), {2} of {3} slices late, slept {4:.1f}% of the time",
+            (double)m_lag * 1000 / m_frequency, (double)m_maxLag * 1000 / m_frequency, m_lateSlices, m_slices, m_slept * 100 / elapsed);
+
+        m_lastReport = now;
+        m_slept = 0;
+        m_maxLag = 0;
+        m_slices = 0;
+        m_lateSlices = 0;
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Options.h"
+
+namespace Cepums {
+
+    // Keeps real time mode in step with the host clock. The machine runs a slice of emulated time,
+    // then waits for the host to catch up: it sleeps for most of the wait and only spins for the
+    // last stretch, where the host's sleep isn't precise enough
+    class HostSync
+    {
+    public:
+        HostSync(const Options& options);
+
+        // Emulated length of a slice in master clock ticks
+        uint64_t getSliceTicks() const { return m_sliceTicks; }
+
+        // Ties the given emulated time to the current host time
+        void reset(uint64_t emulatedTime);
+
+        // Emulated time that lines up with a host performance counter value
+        uint64_t hostToEmulatedTime(uint64_t hostTime) const;
+
+        // Blocks until the host clock has caught up with the given emulated time
+        void waitUntil(uint64_t emulatedTime);
+    private:
+        void report(uint64_t now);
+    private:
+        uint64_t m_frequency;
+        uint64_t m_sliceTicks;
+        uint64_t m_spinTime;
+
+        uint64_t m_anchorHostTime = 0;
+        uint64_t m_anchorTicks = 0;
+
+        // Drift reporting, all in host timer ticks
+        uint64_t m_reportInterval;
+        uint64_t m_lastReport = 0;
+        uint64_t m_slept = 0;
+        uint64_t m_lag = 0;
+        uint64_t m_maxLag = 0;
+        uint64_t m_slices = 0;
+        uint64_t m_lateSlices = 0;
+    };
+}
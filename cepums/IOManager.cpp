@@ -1,657 +1,523 @@
 #include "cepumspch.h"
 #include "IOManager.h"
 
+#include <SDL.h>
+
 #define KIBIBYTE 1024
 #define MEBIBYTE 1048576
 
 namespace Cepums {
 
-    IOManager::IOManager()
+    IOManager::IOManager(const Options& options, Scheduler& scheduler, MemoryManager& memoryManager)
+        : m_scheduler(scheduler)
+        , m_memoryManager(memoryManager)
+        , m_8237DMA(memoryManager)
+        , m_floppy(m_8237DMA, options.diskTiming)
+        , m_fakeFDC(m_floppyDisks[0], memoryManager)
+        , m_hardDiskController(options.diskTiming)
+        , m_diskServices(m_floppyDisks, m_hardDisk, memoryManager)
+        , m_8254PIT(scheduler)
+        , m_speaker(scheduler, m_8254PIT)
     {
+        openFloppyDisks(options);
+        if (!options.hardDiskImage.empty())
+            openHardDisk(options);
+        if (!options.optionROM.empty())
+            m_optionROM.load(options.optionROM, OPTION_ROM_ADDRESS);
+
+        m_inputEvent = m_scheduler.registerEvent("Keyboard input", [this] { injectInput(); });
+
+        registerPorts();
     }
 
     uint8_t IOManager::readByte(uint16_t address)
     {
-        // PIT counter 0
-        if (address == 0x40)
-            return m_8254PIT.readCounter0();
-
-        // PIT counter 1
-        if (address == 0x41)
-            return m_8254PIT.readCounter1();
-
-        // PIT counter 2
-        if (address == 0x42)
-            return m_8254PIT.readCounter2();
-
-        // KBC Data Port
-        if (address == 0x60)
-            return m_8042KBC.readDataPort();
-
-        // I don't know how to deal with this anymore, so let's log and ignore
-        if (address == 0x61)
-        {
-            uint8_t data = 0;
-            /*
-            bit 7   parity check occurred
-            bit 6   channel check occurred
-            bit 5   mirrors timer 2 output condition
-            bit 4   toggles with each refresh request
-            bit 3   channel check status
-            bit 2   parity check status
-            bit 1   speaker data status
-            bit 0   timer 2 gate to speaker status
-            */
-            if (m_refreshRequest)
-            {
-                SET_BIT(data, 4);
-            }
-            SET_BIT(data, 5);
-            SET_BIT(data, 6);
-
-            return data;
-        }
+        auto& handler = m_readHandlers[address & IO_PORT_MASK];
+        if (!handler)
+            return unhandledRead(address);
+        return handler();
+    }
 
-        // XT: PPI Port C - read only
-        if (address == 0x62)
-        {
-            uint8_t data = 0;
+    void IOManager::writeByte(uint16_t address, uint8_t value)
+    {
+        m_writeCount++;
 
-            // Video Switch
-            // MDA
-            SET_BIT(data, 0);
-            SET_BIT(data, 1);
+        auto& handler = m_writeHandlers[address & IO_PORT_MASK];
+        if (!handler)
+            return unhandledWrite(address, value);
+        handler(value);
+    }
 
-            return data;
-        }
+    void IOManager::registerReadHandler(uint16_t port, IOReadHandler handler)
+    {
+        DC_CORE_ASSERT(!m_readHandlers[port & IO_PORT_MASK], "Port already has a read handler");
+        m_readHandlers[port & IO_PORT_MASK] = std::move(handler);
+    }
 
-        // KBC Status Register
-        if (address == 0x64)
-            return m_8042KBC.readStatusRegister();
+    void IOManager::registerWriteHandler(uint16_t port, IOWriteHandler handler)
+    {
+        DC_CORE_ASSERT(!m_writeHandlers[port & IO_PORT_MASK], "Port already has a write handler");
+        m_writeHandlers[port & IO_PORT_MASK] = std::move(handler);
+    }
 
-        // CMOS RAM/RTC data port
-        if (address == 0x71)
-            return m_RTC.readDataPort();
+    void IOManager::registerWordReadHandler(uint16_t port, IOWordReadHandler handler)
+    {
+        DC_CORE_ASSERT(!m_wordReadHandlers[port & IO_PORT_MASK], "Port already has a word read handler");
+        m_wordReadHandlers[port & IO_PORT_MASK] = std::move(handler);
+    }
 
-        // Serial port stuff? (not in PORTS.LST)
-        if (address == 0x2E9)
-            return 0;
+    void IOManager::registerWordWriteHandler(uint16_t port, IOWordWriteHandler handler)
+    {
+        DC_CORE_ASSERT(!m_wordWriteHandlers[port & IO_PORT_MASK], "Port already has a word write handler");
+        m_wordWriteHandlers[port & IO_PORT_MASK] = std::move(handler);
+    }
 
-        // Serial port stuff
-        if (address == 0x2F9)
-            return 0;
+    void IOManager::registerDevice(IODevice& device)
+    {
+        auto& registered = m_devices.emplace_back();
+        registered.device = &device;
+        registered.event = m_scheduler.registerEvent(device.getName(), [this, &registered]
+            {
+                registered.device->runEvent(m_scheduler.eventTime());
+                updateDeviceEvent(registered);
+            });
 
-        // MDA Status register
-        if (address == 0x3BA)
+        for (auto& range : device.getPortRanges())
         {
-            uint8_t data = 0;
-            /*
-            bit 4-7 always 1
-            bit 3:  Video. This is 1 if a green or bright green pixel is being drawn on the screen at this moment
-            bit 1-2 always 0
-            bit 0   Retrace. This is 1 if the horizontal retrace is active
-            */
-            if (m_pretendRetrace)
+            for (uint32_t port = range.first; port <= range.last; port++)
             {
-                SET_BIT(data, 0);
-                m_pretendRetrace = false;
+                // Reads change device state too, like taking a result byte off the FDC
+                registerReadHandler(port, [this, &registered, port]
+                    {
+                        uint8_t value = registered.device->readPort(port);
+                        updateDeviceEvent(registered);
+                        return value;
+                    });
+                registerWriteHandler(port, [this, &registered, port](uint8_t value)
+                    {
+                        registered.device->writePort(port, value);
+                        updateDeviceEvent(registered);
+                    });
             }
-            else
+        }
+
+        for (auto& range : device.getWordPortRanges())
+        {
+            for (uint32_t port = range.first; port <= range.last; port++)
             {
-                m_pretendRetrace = true;
+                registerWordReadHandler(port, [this, &registered, port]
+                    {
+                        uint16_t value = registered.device->readPortWord(port);
+                        updateDeviceEvent(registered);
+                        return value;
+                    });
+                registerWordWriteHandler(port, [this, &registered, port](uint16_t value)
+                    {
+                        registered.device->writePortWord(port, value);
+                        updateDeviceEvent(registered);
+                    });
             }
-            SET_BIT(data, 4);
-            SET_BIT(data, 5);
-            SET_BIT(data, 6);
-            SET_BIT(data, 7);
-
-            return data;
         }
 
-        // Parallel printer data port
-        if (address == 0x03BC || address == 0x0378 || address == 0x0278)
-            return 0;
-
-        // CGA status register
-        if (address == 0x3DA)
-            DC_CORE_ERROR("Accessing a CGA status register - this shouldn't happen");
-
-        // Serial port stuff? (not in PORTS.LST)
-        if (address == 0x3E9)
-            return 0;
+        m_memoryManager.registerDevice(device);
 
-        // Floppy status register A
-        if (address == 0x3F0)
-            return m_floppy.readStatusRegisterA();
-
-        // Floppy status register B
-        if (address == 0x3F1)
-            return m_floppy.readStatusRegisterB();
-
-        // Floppy main status register
-        if (address == 0x3F4)
-            return m_floppy.readMainStatusRegister();
-
-        // Floppy data FIFO
-        if (address == 0x3F5)
-            return m_floppy.readDataFIFO();
-
-        // Floppy digital input register
-        if (address == 0x3F7)
-            return m_floppy.readDigitalInputRegister();
-
-        // Serial port stuff
-        if (address == 0x3F9)
-            return 0;
-
-        DC_CORE_ERROR("IO: Attempt to read at 0x{0:X}", address);
-        TODO();
-        return 0;
+        // Devices without ports have to get their first event from here
+        updateDeviceEvent(registered);
     }
 
-    void IOManager::writeByte(uint16_t address, uint8_t value)
+    void IOManager::updateDeviceEvents()
     {
+        for (auto& registered : m_devices)
+            updateDeviceEvent(registered);
+    }
 
-        // DMA Start Address Register channel 2/6 stub
-        if (address == 0x04)
-        {
-            DC_CORE_TRACE("DMA: Start Address Register channel 2/6 : 0x{0:x}", value);
-            return;
-        }
-
-        // DMA Count Register channel 2/6 stub
-        if (address == 0x05)
-        {
-            DC_CORE_TRACE("DMA: Count Register channel 2/6: 0x{0:x}", value);
-            return;
-        }
-
-        // DMA channel 0-3 command register stub
-        if (address == 0x08)
-        {
-            // 7 bits literally control non-working functionality.
-
-            // Bit 2 being 0 sets DMA on
-            if (value) {
-                // "Disable" DMA controller
-                DC_CORE_WARN("DMA: Command Register: Disabling DMA Controller");
-            }
-            else
-            {
-                // Not handling this case
-            }
-            return;
-        }
-
-        // DMA Single channel mask register
-        if (address == 0x0A)
-        {
-            DC_CORE_TRACE("DMA: Single channel mask register: 0x{0:x}", value);
-            return;
-        }
+    void IOManager::updateDeviceEvent(RegisteredDevice& registered)
+    {
+        uint64_t time = registered.device->getNextEventTime(m_scheduler.now());
+        if (time == NO_EVENT)
+            m_scheduler.cancel(registered.event);
+        else
+            m_scheduler.schedule(registered.event, time);
+    }
 
-        // DMA channel 0-3 mode register
-        if (address == 0x0B)
+    void IOManager::openFloppyDisks(const Options& options)
+    {
+        uint8_t types[FLOPPY_DRIVE_COUNT] = {};
+        for (size_t drive = 0; drive < options.floppyImages.size(); drive++)
         {
-            // If bits 2 and 3 are set, we are running a self test (nothing in our case)
-            if (IS_BIT_NOT_SET(value, 2) && IS_BIT_NOT_SET(value, 3))
-                return;
-
-            if (IS_BIT_SET(value, 2) && IS_BIT_NOT_SET(value, 3))
+            auto& path = options.floppyImages[drive];
+            std::error_code error;
+            size_t size = (size_t)std::filesystem::file_size(path, error);
+            if (error)
             {
-                DC_CORE_TRACE("DMA: \"Writing\" to memory");
-                return;
+                DC_CORE_ERROR("[IOManager]: Can't open floppy image {0}", path);
+                continue;
             }
 
-            if (IS_BIT_NOT_SET(value, 2) && IS_BIT_SET(value, 3))
+            DiskGeometry geometry;
+            if (options.floppyGeometry)
+                geometry = *options.floppyGeometry;
+            else if (!FloppyDiskController::getGeometryForSize(size, geometry))
             {
-                DC_CORE_TRACE("DMA: \"Reading\" from memory");
-                return;
+                DC_CORE_ERROR("[IOManager]: Floppy image {0} isn't the size of any standard format, its layout has to be given with --floppy-geometry", path);
+                continue;
             }
 
-            if (IS_BIT_SET(value, 2) && IS_BIT_SET(value, 3))
-            {
+            auto& disk = m_floppyDisks[drive];
+            if (!disk.open(path, geometry, options.floppyWriteMode))
+                continue;
 
-                DC_CORE_CRITICAL("DMA: Invalid transfer type 0b11");
-                VERIFY_NOT_REACHED();
-            }
-
-            DC_CORE_ERROR("DMA: Unhandled mode register write");
+            DC_CORE_INFO("[IOManager]: Using {0} as floppy drive {1} ({2} cylinders, {3} heads, {4} sectors)", path, drive, geometry.cylinders, geometry.heads, geometry.sectorsPerTrack);
+            m_floppy.insertDisk((uint8_t)drive, &disk);
+            types[drive] = FloppyDiskController::getCMOSDriveType(geometry);
 
-            TODO();
-            return;
+            // Mapping the image is instant, but reading it in isn't
+            disk.preload();
         }
 
-        // DMA flip-flop reset register stub
-        if (address == 0x0C)
-            return;
-
-        // DMA master clear stub
-        if (address == 0x0D)
-            return;
+        // The CMOS only has room for the first two drives, the drive count covers all of them
+        unsigned int driveCount = 0;
+        for (unsigned int drive = 0; drive < FLOPPY_DRIVE_COUNT; drive++)
+        {
+            if (m_floppyDisks[drive].isOpen())
+                driveCount = drive + 1;
+        }
+        m_RTC.setFloppyDrives(types[0], types[1], driveCount);
+    }
 
-        // PIC 1 register 0
-        if (address == 0x20)
+    void IOManager::openHardDisk(const Options& options)
+    {
+        std::error_code error;
+        size_t size = (size_t)std::filesystem::file_size(options.hardDiskImage, error);
+        if (error)
         {
-            DC_CORE_TRACE("PIC1 register 0 stub");
+            DC_CORE_ERROR("[IOManager]: Can't open hard disk image {0}", options.hardDiskImage);
             return;
         }
-
-        // PIC 1 register 1
-        if (address == 0x21)
+        if (size > HARD_DISK_MAX_SIZE)
         {
-            DC_CORE_TRACE("PIC1 register 1 stub");
+            DC_CORE_ERROR("[IOManager]: Hard disk image {0} is bigger than {1} MB", options.hardDiskImage, HARD_DISK_MAX_SIZE / MEBIBYTE);
             return;
         }
 
-        // PIT counter 0
-        if (address == 0x40)
-            return m_8254PIT.writeCounter0(value);
-
-        // PIT counter 1
-        if (address == 0x41)
-            return m_8254PIT.writeCounter1(value);
-
-        // PIT counter 2
-        if (address == 0x42)
-            return m_8254PIT.writeCounter2(value);
+        DiskGeometry geometry = HardDiskController::getGeometryForSize(size);
+        if (!m_hardDisk.open(options.hardDiskImage, geometry, options.hardDiskWriteMode))
+            return;
 
-        // PIT control register
-        if (address == 0x43)
-            return m_8254PIT.writeControlRegister(value);
+        DC_CORE_INFO("[IOManager]: Using {0} as the hard disk ({1} cylinders, {2} heads, {3} sectors)", options.hardDiskImage, geometry.cylinders, geometry.heads, geometry.sectorsPerTrack);
+        m_hardDiskController.insertDisk(&m_hardDisk);
+    }
 
-        // KBC Data Port
-        if (address == 0x60)
-            return m_8042KBC.writeDataPort(value);
+    void IOManager::registerPorts()
+    {
+        m_8254PIT.connectIRQ(m_8259PIC, IRQ_TIMER);
+        m_8042KBC.connectIRQ(m_8259PIC, IRQ_KEYBOARD);
+        m_floppy.connectIRQ(m_8259PIC, IRQ_FLOPPY);
+        m_8254PIT.connectSpeaker(m_speaker);
+
+        registerDevice(m_8237DMA);
+        registerDevice(m_8259PIC);
+        registerDevice(m_8254PIT);
+        registerDevice(m_speaker);
+        registerDevice(m_8042KBC);
+        registerDevice(m_RTC);
+        registerDevice(m_fakeFDC);
+        registerDevice(m_MDA);
+        registerDevice(m_floppy);
+
+        // The controller only shows up on the bus with a disk behind it
+        if (m_hardDisk.isOpen())
+        {
+            m_hardDiskController.connectIRQ(m_8259PIC, IRQ_HARD_DISK);
+            registerDevice(m_hardDiskController);
+        }
 
-        // KBC Command Register
-        if (address == 0x64)
-            return m_8042KBC.writeCommandRegister(value);
+        if (m_optionROM.isLoaded())
+            registerDevice(m_optionROM);
 
-        // CMOS RAM/RTC index register
-        if (address == 0x70)
-            return m_RTC.writeIndexRegister(value);
+        auto ignoreWrites = [](uint8_t) {};
+        auto readZero = [] { return (uint8_t)0; };
 
-        // CMOS RAM/RTC data port
-        if (address == 0x71)
-            return m_RTC.writeDataPort(value);
+        // XT: PPI Port B, only the speaker bits do anything
+        registerReadHandler(0x61, [this] { return readPPIPortB(); });
+        registerWriteHandler(0x61, [this](uint8_t value) { m_speaker.setControl(value); });
 
-        // POST register
-        if (address == 0x80)
-        {
-            m_port0x80 = value;
-            switch (value)
+        // XT: PPI Port C - read only
+        registerReadHandler(0x62, []
             {
-            case 0x00:
-                return DC_CORE_WARN("POST[{0}]: Boot the OS", value);
-            case 0x01:
-                return DC_CORE_WARN("POST[{0}]: Start of BIOS POST, CPU test", value);
-            case 0x02:
-                return DC_CORE_WARN("POST[{0}]: Initial chipset configuration: init PPI, disable NMI, disable turbo, disable display", value);
-            case 0x03:
-                return DC_CORE_WARN("POST[{0}]: Initialize DMA controller", value);
-            case 0x04:
-                return DC_CORE_WARN("POST[{0}]: Test low 32KiB of RAM", value);
-            case 0x05:
-                return DC_CORE_WARN("POST[{0}]: Initialize interrupt table", value);
-            case 0x06:
-                return DC_CORE_WARN("POST[{0}]: Initialize PIT (timer); Player power-on melody", value);
-            case 0x07:
-                return DC_CORE_WARN("POST[{0}]: Initialize PIC", value);
-            case 0x08:
-                return DC_CORE_WARN("POST[{0}]: Initialize KBC and keyboard", value);
-            case 0x09:
-                return DC_CORE_WARN("POST[{0}]: Enable interrupts", value);
-
-            case 0x10:
-                return DC_CORE_WARN("POST[{0}]: Locate video BIOS", value);
-            case 0x11:
-                return DC_CORE_WARN("POST[{0}]: Initialize video BIOS", value);
-            case 0x12:
-                return DC_CORE_WARN("POST[{0}]: No video BIOS, using MDA/CGA", value);
-
-            case 0x20:
-                return DC_CORE_WARN("POST[{0}]: Initialize RTC", value);
-            case 0x21:
-                return DC_CORE_WARN("POST[{0}]: Detect CPU type", value);
-            case 0x22:
-                return DC_CORE_WARN("POST[{0}]: Detect FPU", value);
-            case 0x24:
-                return DC_CORE_WARN("POST[{0}]: Detect serial ports", value);
-            case 0x25:
-                return DC_CORE_WARN("POST[{0}]: Detect parallel ports", value);
-
-            case 0x30:
-                return DC_CORE_WARN("POST[{0}]: Start RAM test", value);
-            case 0x31:
-                return DC_CORE_WARN("POST[{0}]: RAM test completed", value);
-            case 0x32:
-                return DC_CORE_WARN("POST[{0}]: RAM test cancelled", value);
-
-            case 0x40:
-                return DC_CORE_WARN("POST[{0}]: Start BIOS extension ROM scan", value);
-            case 0x41:
-                return DC_CORE_WARN("POST[{0}]: BIOS extension ROM found, initialize", value);
-            case 0x42:
-                return DC_CORE_WARN("POST[{0}]: BIOS extension ROM initialized", value);
-            case 0x43:
-                return DC_CORE_WARN("POST[{0}]: BIOS extension scan complete", value);
-
-            case 0x52:
-                return DC_CORE_WARN("POST[{0}]: CPU test failed", value);
-            case 0x54:
-                return DC_CORE_WARN("POST[{0}]: Low 32 KiB RAM test failed", value);
-            case 0x55:
-                return DC_CORE_WARN("POST[{0}]: RAM test failed", value);
-
-            case 0x60:
-                return DC_CORE_WARN("POST[{0}]: Unable to flush KBC output buffer", value);
-            case 0x61:
-                return DC_CORE_WARN("POST[{0}]: Unable to send command to KBC", value);
-            case 0x62:
-                return DC_CORE_WARN("POST[{0}]: Keyboard controller self test failed", value);
-            case 0x63:
-                return DC_CORE_WARN("POST[{0}]: Keyboard interface test failed", value);
-
-            case 0x70:
-                return DC_CORE_WARN("POST[{0}]: Keyboard BAT test failed", value);
-            case 0x71:
-                return DC_CORE_WARN("POST[{0}]: Keyboard disable command failed", value);
-            case 0x72:
-                return DC_CORE_WARN("POST[{0}]: Keyboard enable command failed", value);
-            default:
-                return DC_CORE_WARN("POST[{0}]: UNKNOWN POST code / possible bug", value);
-            }
-            return;
-        }
+                uint8_t data = 0;
 
-        // DMA page channel 2
-        if (address == 0x81) {
-            m_DMAPageChannel2 = value;
-            return;
-        }
-
-        // DMA page channel 3
-        if (address == 0x82) {
-            m_DMAPageChannel3 = value;
-            return;
-        }
-
-        // DMA page channel 0&1 (might just be 1?)
-        if (address == 0x83) {
-            m_DMAPageChannel0 = value;
-            m_DMAPageChannel1 = value;
-            return;
-        }
+                // Video Switch
+                // MDA
+                SET_BIT(data, 0);
+                SET_BIT(data, 1);
 
-        // I don't know how to deal with this anymore, so let's log and ignore
-        if (address == 0x61)
-        {
-            DC_CORE_TRACE("Dummy write to PPI B control register with 0x{0:x}", value);
-            return;
-        }
+                return data;
+            });
 
         // XT: 8255 PPI control word register
-        if (address == 0x63)
-        {
-            if (value != 0x99)
+        registerWriteHandler(0x63, [](uint8_t value)
             {
-                DC_CORE_TRACE("[PPI]: Unknown word register value - {0:X}", value);
-                return;
-            }
-            return;
-        }
+                if (value != 0x99)
+                    DC_CORE_TRACE("[PPI]: Unknown word register value - {0:X}", value);
+            });
 
-        // PIC 2 register 0
-        if (address == 0xA0)
-        {
-            DC_CORE_TRACE("PIC2 register 0 stub");
-            return;
-        }
+        // POST register
+        registerWriteHandler(0x80, [this](uint8_t value) { writePOSTCode(value); });
 
-        // PIC 2 register 1
-        if (address == 0xA1)
-        {
-            DC_CORE_TRACE("PIC2 register 1 stub");
-            return;
-        }
+        // PIC 2 registers
+        registerWriteHandler(0xA0, [](uint8_t) { DC_CORE_TRACE("PIC2 register 0 stub"); });
+        registerWriteHandler(0xA1, [](uint8_t) { DC_CORE_TRACE("PIC2 register 1 stub"); });
 
         // Used as "Unused register", also 2nd DMA channel 4
-        if (address == 0xC0)
-            return;
-
-        // DUCKMACHINE: Sector count
-        if (address == 0xE0)
-        {
-            m_fakeFDC.setSectorCount(value);
-            return;
-        }
+        registerWriteHandler(0xC0, ignoreWrites);
 
-        // DUCKMACHINE: Command
-        if (address == 0xE1)
+        // Expansion unit (XT)
+        registerWriteHandler(0x213, [](uint8_t value)
+            {
+                switch (value)
+                {
+                case 0:
+                    DC_CORE_TRACE("[XT] Disabling expansion unit (fake)");
+                    return;
+                case 1:
+                    DC_CORE_TRACE("[XT] Enabling expansion unit (fake)");
+                    return;
+                default:
+                    DC_CORE_TRACE("[XT] Unknown value ({0}) for enable/disable expansion unit, ignored", value);
+                    return;
+                }
+            });
+
+        // Serial port stuff (0x2E9 and 0x3E9 are not in PORTS.LST)
+        for (uint16_t port : { 0x2E9, 0x2F9, 0x3E9, 0x3F9 })
         {
-            m_fakeFDC.setCommand(value);
-            return;
+            registerReadHandler(port, readZero);
+            registerWriteHandler(port, ignoreWrites);
         }
 
-        // DUCKMACHINE: Start cylinder
-        if (address == 0xE6)
+        // Parallel printer data ports
+        for (uint16_t port : { 0x3BC, 0x378, 0x278 })
         {
-            m_fakeFDC.setStartCylinder(value);
-            return;
+            registerReadHandler(port, readZero);
+            registerWriteHandler(port, ignoreWrites);
         }
 
-        // DUCKMACHINE: Start sector
-        if (address == 0xE7)
-        {
-            m_fakeFDC.setStartSector(value);
-            return;
-        }
+        // CGA registers, ignored since we pretend to be an MDA
+        for (uint16_t port : { 0x3D4, 0x3D5, 0x3D8, 0x3D9 })
+            registerWriteHandler(port, ignoreWrites);
+    }
 
-        // DUCKMACHINE: Head
-        if (address == 0xE8)
+    uint8_t IOManager::unhandledRead(uint16_t address)
+    {
+        // Nothing drives the bus, so it floats high. Only the first access to each port is logged
+        if (!m_reportedPorts.test(address & IO_PORT_MASK))
         {
-            m_fakeFDC.setHead(value);
-            return;
+            m_reportedPorts.set(address & IO_PORT_MASK);
+            DC_CORE_WARN("IO: Unhandled read at 0x{0:X}", address);
         }
+        return 0xFF;
+    }
 
-
-        // Expansion unit (XT)
-        if (address == 0x213)
+    void IOManager::unhandledWrite(uint16_t address, uint8_t value)
+    {
+        if (!m_reportedPorts.test(address & IO_PORT_MASK))
         {
-            switch (value)
-            {
-            case 0:
-                DC_CORE_TRACE("[XT] Disabling expansion unit (fake)");
-                return;
-            case 1:
-                DC_CORE_TRACE("[XT] Enabling expansion unit (fake)");
-                return;
-            default:
-                DC_CORE_TRACE("[XT] Unknown value ({0}) for enable/disable expansion unit, ignored", value);
-                return;
-            }
-        }
-
-        // Serial port stuff? (not in PORTS.LST)
-        if (address == 0x2E9)
-            return;
-
-        // Serial port stuff
-        if (address == 0x2F9)
-            return;
-
-        // MDA Set current CRTC data register (accessable on 0x03B5 then)
-        if (address == 0x03B4)
-            return;
-
-        // MDA Set current CRTC data register (accessable on 0x03B5 then)
-        if (address == 0x03B5)
-            return;
-
-        // MDA mode control register
-        if (address == 0x03B8)
-        {
-            // Disable video output and set the high-resolution bit
-            if (value == 0x01)
-            {
-                DC_CORE_TRACE("[MDA]: Disable output and set high-res bit");
-                return;
-            }
-
-            // Mode set
-            if (value == 0x29)
-            {
-                DC_CORE_TRACE("[MDA]: Set mode");
-                return;
-            }
-            DC_CORE_ERROR("[MDA]: Unhandled register value {0:X}", value);
-            return;
+            m_reportedPorts.set(address & IO_PORT_MASK);
+            DC_CORE_WARN("IO: Unhandled write at 0x{0:X} with data 0x{1:X}", address, value);
         }
+    }
 
-        // CGA color select register
-        if (address == 0x3B9)
+    uint8_t IOManager::readPPIPortB()
+    {
+        uint8_t data = 0;
+        /*
+        bit 7   parity check occurred
+        bit 6   channel check occurred
+        bit 5   mirrors timer 2 output condition
+        bit 4   toggles with each refresh request
+        bit 3   channel check status
+        bit 2   parity check status
+        bit 1   speaker data status
+        bit 0   timer 2 gate to speaker status
+        */
+        data |= m_speaker.getControl();
+        if (m_8254PIT.getOutput(1))
         {
-            DC_CORE_TRACE("[CGA] Dummy color select register write with value {0}", value);
-            return;
+            SET_BIT(data, 4);
         }
-
-        // Parallel printer data port
-        if (address == 0x03BC || address == 0x0378 || address == 0x0278)
-            return;
-
-        // CGA
-        if (address == 0x03D4 || address == 0x03D5 || address == 0x3D9)
-            return;
-
-        // CGA mode control register
-        if (address == 0x03D8)
+        if (m_8254PIT.getOutput(2))
         {
-            // Disable video output on CGA
-            if (value == 0)
-                return;
-
-            // We're being asked to enable CGA. Uh oh
-            if (value == 1)
-                return;
-
-            // Ignore the rest too
-            return;
+            SET_BIT(data, 5);
         }
+        SET_BIT(data, 6);
 
-        // Serial port stuff? (not in PORTS.LST)
-        if (address == 0x3E9)
-            return;
-
-        // Floppy digital output register (motors, selection and reset)
-        if (address == 0x3F2)
-        {
-            // Generate a FDC interrupt after some time if bit 3 is set
-            if (IS_BIT_SET(value, 3))
-            {
-                m_floppyDelayingForInterrupt = true;
-                m_floppyInterruptCounter = 100;
-            }
-            return m_floppy.writeDigitalOutputRegister(value);
-        }
+        return data;
+    }
 
-        // Floppy data FIFO
-        if (address == 0x3F5)
+    void IOManager::writePOSTCode(uint8_t value)
+    {
+        m_port0x80 = value;
+        switch (value)
         {
-            m_floppy.writeDataFIFO(value);
-            if (m_floppy.performInterruptAfterFIFO())
-            {
-                m_floppyDelayingForInterrupt = true;
-                m_floppyInterruptCounter = 100;
-            }
-            return;
+        case 0x00:
+            return DC_CORE_WARN("POST[{0}]: Boot the OS", value);
+        case 0x01:
+            return DC_CORE_WARN("POST[{0}]: Start of BIOS POST, CPU test", value);
+        case 0x02:
+            return DC_CORE_WARN("POST[{0}]: Initial chipset configuration: init PPI, disable NMI, disable turbo, disable display", value);
+        case 0x03:
+            return DC_CORE_WARN("POST[{0}]: Initialize DMA controller", value);
+        case 0x04:
+            return DC_CORE_WARN("POST[{0}]: Test low 32KiB of RAM", value);
+        case 0x05:
+            return DC_CORE_WARN("POST[{0}]: Initialize interrupt table", value);
+        case 0x06:
+            return DC_CORE_WARN("POST[{0}]: Initialize PIT (timer); Player power-on melody", value);
+        case 0x07:
+            return DC_CORE_WARN("POST[{0}]: Initialize PIC", value);
+        case 0x08:
+            return DC_CORE_WARN("POST[{0}]: Initialize KBC and keyboard", value);
+        case 0x09:
+            return DC_CORE_WARN("POST[{0}]: Enable interrupts", value);
+
+        case 0x10:
+            return DC_CORE_WARN("POST[{0}]: Locate video BIOS", value);
+        case 0x11:
+            return DC_CORE_WARN("POST[{0}]: Initialize video BIOS", value);
+        case 0x12:
+            return DC_CORE_WARN("POST[{0}]: No video BIOS, using MDA/CGA", value);
+
+        case 0x20:
+            return DC_CORE_WARN("POST[{0}]: Initialize RTC", value);
+        case 0x21:
+            return DC_CORE_WARN("POST[{0}]: Detect CPU type", value);
+        case 0x22:
+            return DC_CORE_WARN("POST[{0}]: Detect FPU", value);
+        case 0x24:
+            return DC_CORE_WARN("POST[{0}]: Detect serial ports", value);
+        case 0x25:
+            return DC_CORE_WARN("POST[{0}]: Detect parallel ports", value);
+
+        case 0x30:
+            return DC_CORE_WARN("POST[{0}]: Start RAM test", value);
+        case 0x31:
+            return DC_CORE_WARN("POST[{0}]: RAM test completed", value);
+        case 0x32:
+            return DC_CORE_WARN("POST[{0}]: RAM test cancelled", value);
+
+        case 0x40:
+            return DC_CORE_WARN("POST[{0}]: Start BIOS extension ROM scan", value);
+        case 0x41:
+            return DC_CORE_WARN("POST[{0}]: BIOS extension ROM found, initialize", value);
+        case 0x42:
+            return DC_CORE_WARN("POST[{0}]: BIOS extension ROM initialized", value);
+        case 0x43:
+            return DC_CORE_WARN("POST[{0}]: BIOS extension scan complete", value);
+
+        case 0x52:
+            return DC_CORE_WARN("POST[{0}]: CPU test failed", value);
+        case 0x54:
+            return DC_CORE_WARN("POST[{0}]: Low 32 KiB RAM test failed", value);
+        case 0x55:
+            return DC_CORE_WARN("POST[{0}]: RAM test failed", value);
+
+        case 0x60:
+            return DC_CORE_WARN("POST[{0}]: Unable to flush KBC output buffer", value);
+        case 0x61:
+            return DC_CORE_WARN("POST[{0}]: Unable to send command to KBC", value);
+        case 0x62:
+            return DC_CORE_WARN("POST[{0}]: Keyboard controller self test failed", value);
+        case 0x63:
+            return DC_CORE_WARN("POST[{0}]: Keyboard interface test failed", value);
+
+        case 0x70:
+            return DC_CORE_WARN("POST[{0}]: Keyboard BAT test failed", value);
+        case 0x71:
+            return DC_CORE_WARN("POST[{0}]: Keyboard disable command failed", value);
+        case 0x72:
+            return DC_CORE_WARN("POST[{0}]: Keyboard enable command failed", value);
+        default:
+            return DC_CORE_WARN("POST[{0}]: UNKNOWN POST code / possible bug", value);
         }
-
-        // Floppy configuration control register
-        if (address == 0x3F7)
-            return m_floppy.writeConfigurationControlRegister(value);
-
-        // Serial port stuff
-        if (address == 0x3F9)
-            return;
-
-        DC_CORE_ERROR("IO: Attempt to write at 0x{0:X} with data 0x{1:X}", address, value);
-        TODO();
     }
 
     uint16_t IOManager::readWord(uint16_t address)
     {
-        TODO();
-        return 0;
+        auto& handler = m_wordReadHandlers[address & IO_PORT_MASK];
+        if (handler)
+            return handler();
+
+        uint8_t lower = readByte(address);
+        uint8_t higher = readByte(address + 1);
+        return (uint16_t)higher << 8 | lower;
     }
 
     void IOManager::writeWord(uint16_t address, uint16_t value)
     {
-        // DUCKMACHINE: Upper memory value
-        if (address == 0xE2) {
-            m_fakeFDC.setUpperAddress(value);
-            return;
+        auto& handler = m_wordWriteHandlers[address & IO_PORT_MASK];
+        if (handler)
+        {
+            m_writeCount++;
+            return handler(value);
         }
 
-        // DUCKMACHINE: Lower memory value
-        if (address == 0xE4) {
-            m_fakeFDC.setLowerAddress(value);
-            return;
-        }
+        writeByte(address, value & 0x00FF);
+        writeByte(address + 1, (value >> 8) & 0x00FF);
+    }
 
-        DC_CORE_ERROR("IO: Attempt to write at 0x{0:X} with data 0x{1:X}", address, value);
-        TODO();
+    uint64_t IOManager::getNextPortChange(uint16_t port) const
+    {
+        // PPI port B shows PIT outputs 1 and 2, which are worked out when they're read
+        if ((port & IO_PORT_MASK) == 0x61)
+            return std::min(m_8254PIT.getNextOutputTime(1), m_8254PIT.getNextOutputTime(2));
+        return NO_EVENT;
     }
 
-    void IOManager::runPIT()
+    uint16_t IOManager::getPendingInterrupt()
     {
-        // Generate a floppy interrupt if we need to do that and the delay counter reaches 0
-        if (m_floppyDelayingForInterrupt)
-        {
-            m_floppyInterruptCounter--;
-            if (m_floppyInterruptCounter == 0)
-            {
-                m_pendingInterrupt = true;
-                m_floppyDelayingForInterrupt = false;
-                m_interrupt = 0xE; // IRQ6
-            }
-        }
+        return m_8259PIC.acknowledge();
+    }
 
-        // Update the PIT
-        PITState& state = m_8254PIT.update();
-        if (state.counter1output)
-            m_refreshRequest = true;
-        else
-            m_refreshRequest = false;
+    void IOManager::onKeyPress(SDL_Scancode scancode)
+    {
+        queueInput(scancode, true);
     }
 
-    bool IOManager::hasPendingInterrupts()
+    void IOManager::onKeyRelease(SDL_Scancode scancode)
     {
-        return m_pendingInterrupt;
+        queueInput(scancode, false);
     }
 
-    uint16_t IOManager::getPendingInterrupt()
+    void IOManager::queueInput(SDL_Scancode scancode, bool pressed)
     {
-        m_pendingInterrupt = false;
-        return m_interrupt;
+        if (!m_inputQueue.push({ scancode, pressed, SDL_GetPerformanceCounter() }))
+            DC_CORE_WARN("[IOManager]: Input queue is full, dropping a key");
     }
 
-    void IOManager::onKeyPress(SDL_Scancode scancode)
+    void IOManager::deliverInput(const InputEvent& event, uint64_t time)
     {
-        std::lock_guard<std::mutex> guard(m_keyboardMutex);
-        // Tell KBC to return a key press
-        m_8042KBC.keyPressed(scancode);
+        // Keys never overtake each other
+        if (!m_pendingInput.empty())
+            time = std::max(time, m_pendingInput.back().first);
 
-        m_pendingInterrupt = true;
-        m_interrupt = 9; // IRQ1
+        m_pendingInput.emplace_back(time, event);
+        if (!m_scheduler.isScheduled(m_inputEvent))
+            m_scheduler.schedule(m_inputEvent, time);
     }
 
-    void IOManager::onKeyRelease(SDL_Scancode scancode)
+    void IOManager::injectInput()
     {
-        std::lock_guard<std::mutex> guard(m_keyboardMutex);
-        m_8042KBC.keyReleased(scancode);
+        InputEvent event = m_pendingInput.front().second;
+        m_pendingInput.pop_front();
+
+        if (event.pressed)
+            m_8042KBC.keyPressed(event.scancode);
+        else
+            m_8042KBC.keyReleased(event.scancode);
+        m_8259PIC.pulseIRQ(IRQ_KEYBOARD);
 
-        m_pendingInterrupt = true;
-        m_interrupt = 9; // IRQ1
+        if (!m_pendingInput.empty())
+            m_scheduler.schedule(m_inputEvent, m_pendingInput.front().first);
     }
 }
@@ -1,58 +1,149 @@
 #pragma once
 
+#include <bitset>
+#include <deque>
 #include <utility>
 #include <vector>
 
+#include "Hardware/DMAController.h"
 #include "Hardware/FakeFDC.h"
 #include "Hardware/FloppyDiskController.h"
+#include "Hardware/HardDiskController.h"
+#include "Hardware/IODevice.h"
 #include "Hardware/KeyboardController.h"
+#include "Hardware/MDA.h"
+#include "Hardware/OptionROM.h"
+#include "Hardware/PIC.h"
 #include "Hardware/PIT.h"
 #include "Hardware/RTC.h"
+#include "Hardware/Speaker.h"
 #include "MemoryManager.h"
+#include "Options.h"
+#include "Scheduler.h"
+#include "SPSCQueue.h"
+#include "Storage/DiskServices.h"
+
+// How many key events the UI thread can get ahead of the processing thread
+#define INPUT_QUEUE_SIZE 256
+
+// The XT only decodes the low 10 address bits on the bus, everything above is an alias
+#define IO_PORT_COUNT 1024
+#define IO_PORT_MASK (IO_PORT_COUNT - 1)
 
 namespace Cepums {
 
+    struct InputEvent
+    {
+        SDL_Scancode scancode;
+        bool pressed;
+        uint64_t hostTime; // Host performance counter when the key was pressed or released
+    };
+
+    using IOReadHandler = std::function<uint8_t()>;
+    using IOWriteHandler = std::function<void(uint8_t)>;
+    using IOWordReadHandler = std::function<uint16_t()>;
+    using IOWordWriteHandler = std::function<void(uint16_t)>;
+
     class IOManager
     {
     public:
-        IOManager();
+        IOManager(const Options& options, Scheduler& scheduler, MemoryManager& memoryManager);
 
         uint8_t readByte(uint16_t address);
         void writeByte(uint16_t address, uint8_t value);
 
+        // Ports without a word handler see two byte accesses, like on the 8088's 8-bit bus
         uint16_t readWord(uint16_t address);
         void writeWord(uint16_t address, uint16_t value);
 
-        void runPIT();
-        void runFakeFDC(MemoryManager& memoryManager) { m_fakeFDC.execute(memoryManager); }
+        // Number of writes so far, used to tell loops without side effects apart
+        uint64_t getWriteCount() const { return m_writeCount; }
 
-        bool hasPendingInterrupts();
+        MDA& getMDA() { return m_MDA; }
+        DiskServices& getDiskServices() { return m_diskServices; }
+        Speaker& getSpeaker() { return m_speaker; }
+
+        // Asks every device for its next event again, for changes made to them before the processing thread started
+        void updateDeviceEvents();
+
+        // When a port's value can next change without a device event (NO_EVENT if it can't)
+        uint64_t getNextPortChange(uint16_t port) const;
+
+        bool hasPendingInterrupts() const { return m_8259PIC.hasPendingInterrupt(); }
         uint16_t getPendingInterrupt();
 
+        // Called from the UI thread, only queue the key for the processing thread
         void onKeyPress(SDL_Scancode scancode);
         void onKeyRelease(SDL_Scancode scancode);
+
+        // Processing thread side of the key queue. Delivered keys reach the KBC at the given emulated time
+        bool popInput(InputEvent& event) { return m_inputQueue.pop(event); }
+        void deliverInput(const InputEvent& event, uint64_t time);
     private:
+        struct RegisteredDevice
+        {
+            IODevice* device;
+            EventID event;
+        };
+
+        // Every port gets at most one handler of each kind, ports without one take the unhandled path
+        void registerReadHandler(uint16_t port, IOReadHandler handler);
+        void registerWriteHandler(uint16_t port, IOWriteHandler handler);
+        void registerWordReadHandler(uint16_t port, IOWordReadHandler handler);
+        void registerWordWriteHandler(uint16_t port, IOWordWriteHandler handler);
+        void registerDevice(IODevice& device);
+        void openFloppyDisks(const Options& options);
+        void openHardDisk(const Options& options);
+        void registerPorts();
+
+        // Moves the device's scheduler event to wherever the device wants it now
+        void updateDeviceEvent(RegisteredDevice& registered);
+
+        uint8_t unhandledRead(uint16_t address);
+        void unhandledWrite(uint16_t address, uint8_t value);
+
+        uint8_t readPPIPortB();
+        void writePOSTCode(uint8_t value);
+
+        void queueInput(SDL_Scancode scancode, bool pressed);
+        void injectInput();
+    private:
+        Scheduler& m_scheduler;
+        MemoryManager& m_memoryManager;
+
+        // Port dispatch, indexed by the decoded port number
+        std::array<IOReadHandler, IO_PORT_COUNT> m_readHandlers;
+        std::array<IOWriteHandler, IO_PORT_COUNT> m_writeHandlers;
+        std::array<IOWordReadHandler, IO_PORT_COUNT> m_wordReadHandlers;
+        std::array<IOWordWriteHandler, IO_PORT_COUNT> m_wordWriteHandlers;
+        std::bitset<IO_PORT_COUNT> m_reportedPorts;
+
+        // Stable addresses, the handlers point into it
+        std::deque<RegisteredDevice> m_devices;
+
+        uint64_t m_writeCount = 0;
         uint8_t m_port0x80;
+        // Shared by both floppy controllers, so they have to come before them
+        DiskBackend m_floppyDisks[FLOPPY_DRIVE_COUNT];
+
+        DMAController m_8237DMA;
         FloppyDiskController m_floppy;
         FakeFDC m_fakeFDC;
+        DiskBackend m_hardDisk;
+        HardDiskController m_hardDiskController;
+        DiskServices m_diskServices;
         KeyboardController m_8042KBC;
+        MDA m_MDA;
+        OptionROM m_optionROM;
+        PIC m_8259PIC;
         PIT m_8254PIT;
+        Speaker m_speaker;
         RTC m_RTC;
 
-        // State stuff
-        bool m_refreshRequest = false;
-        bool m_pretendRetrace = false;
-        std::mutex m_keyboardMutex;
-        bool m_pendingInterrupt = false;
-        uint8_t m_interrupt = 0;
-
-        bool m_floppyDelayingForInterrupt = false;
-        unsigned int m_floppyInterruptCounter;
-
-        // DMA stuff
-        uint8_t m_DMAPageChannel0{ 0 };
-        uint8_t m_DMAPageChannel1{ 0 };
-        uint8_t m_DMAPageChannel2{ 0 };
-        uint8_t m_DMAPageChannel3{ 0 };
+        // Keys on their way from the UI thread, then waiting for their emulated time
+        SPSCQueue<InputEvent, INPUT_QUEUE_SIZE> m_inputQueue;
+        std::deque<std::pair<uint64_t, InputEvent>> m_pendingInput;
+
+        EventID m_inputEvent;
     };
 }
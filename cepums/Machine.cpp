@@ -0,0 +1,106 @@
+#include "cepumspch.h"
+#include "Machine.h"
+
+// How many master clock ticks fast-forward runs between checks of the mode
+#define TICKS_PER_BATCH (1024 * CPU_CLOCK_DIVIDER)
+
+namespace Cepums {
+
+    Machine::Machine(const Options& options)
+        : m_hostSync(options)
+        , m_ioManager(options, m_scheduler, m_memoryManager)
+        , m_fastForward(options.fastForward)
+    {
+        m_processor.setIdleLoopDetection(options.idleSkip);
+        m_processor.setDiskServices(options.diskServicesHLE ? &m_ioManager.getDiskServices() : nullptr);
+    }
+
+    void Machine::run(std::atomic<bool>& shouldExecute)
+    {
+        // Devices can change between their registration and now, like the speaker getting its output
+        m_ioManager.updateDeviceEvents();
+
+        // Real time is kept relative to the point where it was last switched on, so the time spent
+        // fast-forwarding isn't made up for by stalling afterwards
+        bool fastForward = !m_fastForward;
+
+        while (shouldExecute)
+        {
+            if (fastForward != m_fastForward)
+            {
+                fastForward = m_fastForward;
+                m_hostSync.reset(m_scheduler.now());
+                DC_CORE_INFO("[Machine]: Running in {0} mode", fastForward ? "fast-forward" : "real time");
+            }
+
+            deliverInput(fastForward);
+
+            if (fastForward)
+            {
+                runUntil(m_scheduler.now() + TICKS_PER_BATCH);
+            }
+            else
+            {
+                // After a host stall the wait returns right away until the missed time is caught up,
+                // with every event still at its own emulated time
+                runUntil(m_scheduler.now() + m_hostSync.getSliceTicks());
+                m_hostSync.waitUntil(m_scheduler.now());
+            }
+        }
+
+        DC_CORE_INFO("[Machine]: Stopped after {0:.3f} emulated seconds", masterTicksToSeconds(m_scheduler.now()));
+    }
+
+    void Machine::deliverInput(bool fastForward)
+    {
+        InputEvent event;
+        while (m_ioManager.popInput(event))
+        {
+            // In real time keys are replayed one slice late, so they keep the spacing they had on the host.
+            // Fast-forward has nothing to do with the host clock, so they go in right away
+            uint64_t time = m_scheduler.now();
+            if (!fastForward)
+                time = std::max(time, m_hostSync.hostToEmulatedTime(event.hostTime) + m_hostSync.getSliceTicks());
+            m_ioManager.deliverInput(event, time);
+        }
+    }
+
+    void Machine::runUntil(uint64_t target)
+    {
+        while (m_scheduler.now() < target)
+        {
+            // The CPU runs up to the next device event. It can move closer while the CPU runs,
+            // for example when an I/O write starts a command
+            while (m_scheduler.now() < target && m_scheduler.now() < m_scheduler.nextDeadline())
+            {
+                // Nothing can change before the next event, so the time until then is skipped
+                if (m_processor.isIdle(m_ioManager))
+                {
+                    // Some ports change without an event, a loop polling one of them can only skip until then
+                    uint64_t until = std::min(target, m_scheduler.nextDeadline());
+                    if (auto port = m_processor.getPolledPort())
+                        until = std::min(until, m_ioManager.getNextPortChange(*port));
+
+                    skipIdleTime(until);
+                    break;
+                }
+
+                m_processor.execute(m_memoryManager, m_ioManager);
+                m_scheduler.advance(CPU_CLOCK_DIVIDER);
+            }
+
+            m_scheduler.runDueEvents();
+        }
+    }
+
+    void Machine::skipIdleTime(uint64_t until)
+    {
+        // Stay on a CPU clock edge
+        until = (until + CPU_CLOCK_DIVIDER - 1) / CPU_CLOCK_DIVIDER * CPU_CLOCK_DIVIDER;
+        if (until > m_scheduler.now())
+            m_scheduler.advanceTo(until);
+
+        // Let a polling loop run again to see if whatever it's waiting for has happened
+        m_processor.wakeFromPolling();
+    }
+}
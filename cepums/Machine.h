@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+#include "HostSync.h"
+#include "IOManager.h"
+#include "MemoryManager.h"
+#include "Options.h"
+#include "Processor/Processor.h"
+#include "Scheduler.h"
+
+namespace Cepums {
+
+    // Owns the emulated hardware and runs it on the processing thread.
+    // Emulated time is counted in master clock ticks and either follows the host clock (real time)
+    // or advances as fast as the host can execute instructions (fast-forward)
+    class Machine
+    {
+    public:
+        Machine(const Options& options);
+
+        // Runs the emulation until shouldExecute is cleared
+        void run(std::atomic<bool>& shouldExecute);
+
+        // Can be called from any thread, the processing thread picks the change up right away
+        void toggleFastForward() { m_fastForward = !m_fastForward; }
+
+        MemoryManager& getMemoryManager() { return m_memoryManager; }
+        IOManager& getIOManager() { return m_ioManager; }
+    private:
+        void deliverInput(bool fastForward);
+        void runUntil(uint64_t target);
+        void skipIdleTime(uint64_t until);
+    private:
+        Scheduler m_scheduler;
+        HostSync m_hostSync;
+        Processor m_processor;
+        MemoryManager m_memoryManager;
+        IOManager m_ioManager;
+
+        std::atomic<bool> m_fastForward;
+    };
+}
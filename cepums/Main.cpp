@@ -1,32 +1,30 @@
 #include "cepumspch.h"
 
 #include "Core.h"
-#include "IOManager.h"
+#include "Hardware/MDA.h"
+#include "Hardware/Speaker.h"
+#include "Headless.h"
 #include "Log.h"
-#include "MemoryManager.h"
-#include "Processor/Processor.h"
+#include "Machine.h"
+#include "Options.h"
+#include "Stats.h"
 
 #include <thread>
 
 #define SDL_MAIN_HANDLED
 #include <SDL.h>
 
+// The MDA refreshes the screen at ~50 Hz
+#define MDA_REFRESH_RATE 50
+
 SDL_Texture* g_charBitmaps[256];
 
 bool loadFontTextures(SDL_Renderer* renderer)
 {
     // Load font file
-    std::ifstream font_stream("default-font.bin", std::ios::in | std::ios::binary);
-    if (!font_stream)
-    {
-        DC_CORE_ERROR("Font loader failed to open 'default-font.bin' fot file");
+    std::vector<uint8_t> font_raw;
+    if (!Cepums::loadMDAFont(font_raw))
         return false;
-    }
-
-    // Read the font file
-    uint8_t font_raw[16 * 256];
-    font_stream.read((char *)&font_raw, 4096);
-    font_stream.close();
 
     SDL_Surface* surf = nullptr;
 
@@ -88,14 +86,38 @@ void deleteFontTextures()
     }
 }
 
-int main(int argc, char** argv)
+// Runs on SDL's audio thread
+void SDLCALL fillAudioBuffer(void* userdata, Uint8* stream, int length)
 {
-    SDL_SetMainReady();
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
+    auto speaker = (Cepums::Speaker*)userdata;
+    speaker->playSamples((int16_t*)stream, length / sizeof(int16_t));
+}
 
-    // Initialize the basics
-    Cepums::Log::init();
-    DC_CORE_INFO("Cepums-86 starting up ...");
+// The speaker, a missing audio device only costs the sound
+SDL_AudioDeviceID openAudioDevice(Cepums::Speaker& speaker)
+{
+    SDL_AudioSpec audioSpec = {};
+    audioSpec.freq = SPEAKER_SAMPLE_RATE;
+    audioSpec.format = AUDIO_S16SYS;
+    audioSpec.channels = 1;
+    audioSpec.samples = 1024;
+    audioSpec.callback = fillAudioBuffer;
+    audioSpec.userdata = &speaker;
+    SDL_AudioDeviceID audioDevice = SDL_OpenAudioDevice(nullptr, 0, &audioSpec, nullptr, 0);
+    if (!audioDevice)
+    {
+        DC_CORE_ERROR("SDL_OpenAudioDevice: {0}", SDL_GetError());
+        return 0;
+    }
+
+    speaker.setOutputEnabled(true);
+    SDL_PauseAudioDevice(audioDevice, 0);
+    return audioDevice;
+}
+
+int runWindowed(const Cepums::Options& options, Cepums::Machine& machine, std::atomic<bool>& shouldExecute)
+{
+    Cepums::IOManager& ioManager = machine.getIOManager();
 
     // Create a window (regular MDA is 720x350)
     SDL_Window* window = SDL_CreateWindow("Cepums-86", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 720, 400, 0);
@@ -108,7 +130,7 @@ int main(int argc, char** argv)
     }
 
     // Create the renderer
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (options.vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
 
     // Load the font
     if (!loadFontTextures(renderer))
@@ -116,17 +138,10 @@ int main(int argc, char** argv)
         DC_CORE_CRITICAL("Font file 'default-font.bin' not found! Shutting down :(");
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
-        SDL_Quit();
 
-        return 0;
+        return 1;
     }
 
-    // Make a processor
-    Cepums::Processor processor;
-
-    Cepums::MemoryManager memoryManager;
-    Cepums::IOManager ioManager;
-
     SDL_Rect font_rect;
     font_rect.x = 0;
     font_rect.y = 0;
@@ -136,80 +151,73 @@ int main(int argc, char** argv)
     SDL_Rect bg_rect;
     bg_rect.x = 0;
     bg_rect.y = 0;
-    bg_rect.w = 9;
-    bg_rect.h = 16;
+    bg_rect.w = MDA_CELL_WIDTH;
+    bg_rect.h = MDA_CELL_HEIGHT;
 
     SDL_RendererFlip flip_font = static_cast<SDL_RendererFlip>(SDL_FLIP_HORIZONTAL);
 
-    bool shouldExecute = true;
+    unsigned int lastTime = 0;
+    unsigned int currentTime = 0;
 
-    // Create the Processor loop thread
-    std::thread processing([&] {
-        uint64_t thrLastTime = 0;
-        uint64_t thrCurrentTime = 0;
-        double processorTimerAccumulator = 0;
-        double PITTimerAccumulator = 0;
+    unsigned int blinkTime = 0;
 
-        while (shouldExecute)
+    auto handleEvent = [&](SDL_Event& event) {
+        switch (event.type)
         {
-            thrLastTime = thrCurrentTime;
-            thrCurrentTime = SDL_GetPerformanceCounter();
-            double delta = (double)(thrCurrentTime - thrLastTime) * 1000 * 1000 / SDL_GetPerformanceFrequency(); // This is in microseconds
-            processorTimerAccumulator += delta;
-            PITTimerAccumulator += delta;
-
-            // Run the CPU at 4.77272666 MHz
-            if (processorTimerAccumulator > 0.20952383642268)
-            {
-                processorTimerAccumulator = 0;
-                processor.execute(memoryManager, ioManager);
-            }
-
-            ioManager.runFakeFDC(memoryManager);
-
-            // Run the PIT at 1.193182 MHz
-            if (PITTimerAccumulator > 0.83809511038551)
+        case SDL_KEYDOWN:
+            // Pause isn't on the XT keyboard, so it's kept for toggling fast-forward
+            if (event.key.keysym.scancode == SDL_SCANCODE_PAUSE)
             {
-                PITTimerAccumulator = 0;
-                ioManager.runPIT();
+                if (!event.key.repeat)
+                    machine.toggleFastForward();
+                break;
             }
+            ioManager.onKeyPress(event.key.keysym.scancode);
+            break;
+        case SDL_KEYUP:
+            if (event.key.keysym.scancode == SDL_SCANCODE_PAUSE)
+                break;
+            ioManager.onKeyRelease(event.key.keysym.scancode);
+            break;
+        case SDL_QUIT:
+            shouldExecute = false;
+            break;
+        default:
+            break;
         }
-    });
+    };
 
-    uint8_t colorRegularR = 0xCC;
-    uint8_t colorRegularG = 0x99;
-    uint8_t colorRegularB = 0x00;
+    Cepums::Stats stats(options.statsInterval);
 
-    uint8_t colorIntenseR = 0xFF;
-    uint8_t colorIntenseG = 0xCF;
-    uint8_t colorIntenseB = 0x00;
-
-    unsigned int lastTime = 0;
-    unsigned int currentTime = 0;
-
-    unsigned int blinkTime = 0;
+    // With vsync the present call does the pacing for us
+    uint64_t framePeriod = options.vsync ? 0 : SDL_GetPerformanceFrequency() / MDA_REFRESH_RATE;
+    uint64_t nextFrame = SDL_GetPerformanceCounter();
 
     while (shouldExecute)
     {
-        SDL_Event event;
-        while (SDL_PollEvent(&event))
+        // Sleep in the event queue until the next frame is due so input is still handled right away
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now < nextFrame)
         {
-            switch (event.type)
+            SDL_Event event;
+            int timeout = (int)((nextFrame - now) * 1000 / SDL_GetPerformanceFrequency());
+            if (timeout > 0)
             {
-            case SDL_KEYDOWN:
-                ioManager.onKeyPress(event.key.keysym.scancode);
-                break;
-            case SDL_KEYUP:
-                ioManager.onKeyRelease(event.key.keysym.scancode);
-                break;
-            case SDL_QUIT:
-                shouldExecute = false;
-                break;
-            default:
-                break;
+                if (SDL_WaitEventTimeout(&event, timeout))
+                    handleEvent(event);
+                continue;
             }
         }
 
+        SDL_Event event;
+        while (SDL_PollEvent(&event))
+            handleEvent(event);
+
+        // Schedule the next frame, but don't try to catch up on frames we've missed
+        nextFrame += framePeriod;
+        if (nextFrame < now)
+            nextFrame = now + framePeriod;
+
         lastTime = currentTime;
         currentTime = SDL_GetTicks();
 
@@ -221,7 +229,7 @@ int main(int argc, char** argv)
             blinkTime = 0;
 
         // Get the MDA RAM
-        auto mda = memoryManager.getMDA();
+        auto mda = ioManager.getMDA().getVideoRAM();
 
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
@@ -231,101 +239,122 @@ int main(int argc, char** argv)
         font_rect.y = 0;
         bg_rect.x = 0;
         bg_rect.y = 0;
-        for (auto y = 0; y < 25; y++)
+        for (auto y = 0; y < MDA_ROWS; y++)
         {
-            for (auto  x = 0; x < 80; x++)
+            for (auto x = 0; x < MDA_COLUMNS; x++)
             {
-                bool blink = false;
-                bool high_intensity = false;
-                bool invert = false;
-                bool blank = false;
-                bool underline = false;
                 uint8_t character = mda.at((x * 2 + 160 * y));
-                uint8_t attribute = mda.at((x * 2 + 160 * y) + 1);
-
-                // Inverting and blank are special cases
-                if (attribute == 0x70 || attribute == 0x78 || attribute == 0xF0 || attribute == 0xF8)
-                    invert = true;
-                else if (attribute == 0x00 || attribute == 0x08 || attribute == 0x80 || attribute == 0x88)
-                    blank = true;
-
-                // Underline checking requires some fancy stuff
-                if (IS_BIT_SET(attribute, 0) && IS_BIT_NOT_SET(attribute, 1) && IS_BIT_NOT_SET(attribute, 2))
-                    underline = true;
-
-                // Bit 7 is blink
-                if (IS_BIT_SET(attribute, 7))
-                    blink = true;
-
-                // Bit 3 is high intensity
-                if (IS_BIT_SET(attribute, 3))
-                    high_intensity = true;
+                const Cepums::MDAAttribute& attribute = Cepums::s_MDAAttributeTable[mda.at((x * 2 + 160 * y) + 1)];
 
                 // Skip if blank :)
-                if (blank)
+                if (attribute.isBlank())
                 {
-                    font_rect.x += 9;
-                    bg_rect.x += 9;
+                    font_rect.x += MDA_CELL_WIDTH;
+                    bg_rect.x += MDA_CELL_WIDTH;
                     continue;
                 }
 
                 // Draw background only if it's inverted
-                if (invert)
+                if (attribute.background != Cepums::MDAColor::Black)
                 {
-                    // High or regular intensity
-                    if (high_intensity)
-                        SDL_SetRenderDrawColor(renderer, colorIntenseR, colorIntenseG, colorIntenseB, 255);
-                    else
-                        SDL_SetRenderDrawColor(renderer, colorRegularR, colorRegularG, colorRegularB, 255);
+                    auto& background = Cepums::s_MDAPalette[(size_t)attribute.background];
+                    SDL_SetRenderDrawColor(renderer, background.r, background.g, background.b, 255);
                     SDL_RenderFillRect(renderer, &bg_rect);
-
-                    // Set character color to black in this case
-                    SDL_SetTextureColorMod(g_charBitmaps[character], 0, 0, 0);
-                }
-                else
-                {
-                    if (high_intensity)
-                    {
-                        SDL_SetRenderDrawColor(renderer, colorIntenseR, colorIntenseG, colorIntenseB, 255);
-                        SDL_SetTextureColorMod(g_charBitmaps[character], colorIntenseR, colorIntenseG, colorIntenseB);
-                    }
-                    else
-                    {
-                        SDL_SetRenderDrawColor(renderer, colorRegularR, colorRegularG, colorRegularB, 255);
-                        SDL_SetTextureColorMod(g_charBitmaps[character], colorRegularR, colorRegularG, colorRegularB);
-                    }
                 }
 
-                if (!blink || (blink && blinkTime > 500))
+                auto& foreground = Cepums::s_MDAPalette[(size_t)attribute.foreground];
+                SDL_SetRenderDrawColor(renderer, foreground.r, foreground.g, foreground.b, 255);
+                SDL_SetTextureColorMod(g_charBitmaps[character], foreground.r, foreground.g, foreground.b);
+
+                if (!attribute.blink || blinkTime > 500)
                 {
-                    if (underline)
-                        SDL_RenderDrawLine(renderer, bg_rect.x, bg_rect.y + 14, bg_rect.x + 8, bg_rect.y + 14);
+                    if (attribute.underline)
+                        SDL_RenderDrawLine(renderer, bg_rect.x, bg_rect.y + MDA_UNDERLINE_ROW, bg_rect.x + 8, bg_rect.y + MDA_UNDERLINE_ROW);
                     SDL_RenderCopyEx(renderer, g_charBitmaps[character], nullptr, &font_rect, 0, nullptr, flip_font);
                 }
 
-                font_rect.x += 9;
-                bg_rect.x += 9;
+                font_rect.x += MDA_CELL_WIDTH;
+                bg_rect.x += MDA_CELL_WIDTH;
             }
 
             font_rect.x = 0;
-            font_rect.y += 16;
+            font_rect.y += MDA_CELL_HEIGHT;
             bg_rect.x = 0;
-            bg_rect.y += 16;
+            bg_rect.y += MDA_CELL_HEIGHT;
         }
 
         // Swaps buffers I think
         SDL_RenderPresent(renderer);
-    }
 
-    // Quit
-    shouldExecute = false;
-    processing.join();
+        stats.frameRendered();
+        stats.update();
+    }
 
     // Clean up SDL stuff
     deleteFontTextures();
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
-    SDL_Quit();
 
     return 0;
 }
+
+int main(int argc, char** argv)
+{
+    SDL_SetMainReady();
+
+    // Initialize the basics
+    Cepums::Log::init();
+
+    Cepums::Options options;
+    if (!Cepums::parseOptions(argc, argv, options))
+        return 1;
+
+    // Headless mode doesn't need anything but timers
+    if (options.headless)
+        SDL_Init(SDL_INIT_TIMER);
+    else
+        SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER);
+
+    DC_CORE_INFO("Cepums-86 starting up ...");
+
+    Cepums::Machine machine(options);
+
+    // Whatever takes the speaker's samples has to be in place before the processing thread starts
+    Cepums::Speaker& speaker = machine.getIOManager().getSpeaker();
+    SDL_AudioDeviceID audioDevice = 0;
+    if (!options.headless)
+    {
+        audioDevice = openAudioDevice(speaker);
+    }
+    else if (!options.audioDump.empty() && !speaker.startRecording(options.audioDump))
+    {
+        SDL_Quit();
+        return 1;
+    }
+
+    std::atomic<bool> shouldExecute = true;
+
+    // Create the Processor loop thread
+    std::thread processing([&] {
+        machine.run(shouldExecute);
+    });
+
+    int result = 0;
+    if (options.headless)
+        result = Cepums::runHeadless(options, machine.getIOManager(), shouldExecute);
+    else
+        result = runWindowed(options, machine, shouldExecute);
+
+    // Quit
+    shouldExecute = false;
+    processing.join();
+
+    // Renders what's left of the recording now that nothing else touches the speaker
+    speaker.stopRecording();
+    if (audioDevice)
+        SDL_CloseAudioDevice(audioDevice);
+
+    SDL_Quit();
+
+    return result;
+}
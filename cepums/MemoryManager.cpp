@@ -1,6 +1,8 @@
 #include "cepumspch.h"
 #include "MemoryManager.h"
 
+#include <cstring>
+
 #define KIBIBYTE 1024
 #define MEBIBYTE 1048576
 
@@ -11,32 +13,6 @@ namespace Cepums {
         m_RAM.resize(640 * KIBIBYTE);
         m_BIOS_F0000.resize(32 * KIBIBYTE);
         m_BIOS_F8000.resize(32 * KIBIBYTE);
-        m_MDA.resize(80 * 25 * 2);
-
-#if 0
-        // Test MDA
-        uint8_t attribute = 0;
-
-        for (auto y = 0; y < 16; y++)
-        {
-            for (auto x = 0; x < 16 * 3 * 2; x += 3 * 2)
-            {
-                uint8_t char0 = halfByteToHexChar(LOWER_HALFBYTE(attribute));
-                uint8_t char1 = halfByteToHexChar(HIGHER_HALFBYTE(attribute));
-
-                m_MDA.at((x + 80 * 2 * y) + 0) = char1; // upper half of attribute
-                m_MDA.at((x + 80 * 2 * y) + 1) = attribute;
-
-                m_MDA.at((x + 80 * 2 * y) + 2) = char0; // lower half of attribute
-                m_MDA.at((x + 80 * 2 * y) + 3) = attribute;
-
-                m_MDA.at((x + 80 * 2 * y) + 4) = 0;
-                m_MDA.at((x + 80 * 2 * y) + 5) = attribute;
-
-                attribute++;
-            }
-        }
-#endif
 
         // Load BASIC and BIOS roms
         std::ifstream firstROMbinary;
@@ -79,17 +55,9 @@ namespace Cepums {
         if (physical < 0xA0000)
             return m_RAM.at(physical);
 
-        // MDA :)
-        if (physical >= 0xB0000 && physical <= 0xB7FFF)
-        {
-            physical -= 0xB0000;
-            // The address repeats for the entire 32k range
-            while (physical >= m_MDA.size())
-            {
-                physical -= (uint32_t)m_MDA.size();
-            }
-            return getMDA().at(physical);
-        }
+        // Memory mapped devices
+        if (IODevice* device = getDevice(physical))
+            return device->readMemory(physical);
 
         if (physical < 0xF0000)
         {
@@ -127,6 +95,7 @@ namespace Cepums {
 
     void MemoryManager::writeByte(uint16_t segment, uint16_t offset, uint8_t value)
     {
+        m_writeCount++;
         uint32_t physical = addresstoPhysical(segment, offset);
 
         // Is this in RAM (lower 640k?)
@@ -136,18 +105,9 @@ namespace Cepums {
             return;
         }
 
-        // MDA :)
-        if (physical >= 0xB0000 && physical <= 0xB7FFF)
-        {
-            physical -= 0xB0000;
-            // The address repeats for the entire 32k range
-            while (physical >= m_MDA.size())
-            {
-                physical -= (uint32_t)m_MDA.size();
-            }
-            getMDA().at(physical) = value;
-            return;
-        }
+        // Memory mapped devices
+        if (IODevice* device = getDevice(physical))
+            return device->writeMemory(physical, value);
 
         TODO();
     }
@@ -164,17 +124,11 @@ namespace Cepums {
             return (uint16_t)second << 8 | first;
         }
 
-        // MDA :)
-        if (physical >= 0xB0000 && physical <= 0xB7FFF)
+        // Memory mapped devices
+        if (IODevice* device = getDevice(physical))
         {
-            physical -= 0xB0000;
-            // The address repeats for the entire 32k range
-            while (physical >= m_MDA.size())
-            {
-                physical -= (uint32_t)m_MDA.size();
-            }
-            auto first = getMDA().at(physical);
-            auto second = getMDA().at(++physical);
+            auto first = device->readMemory(physical);
+            auto second = device->readMemory(++physical);
             return (uint16_t)second << 8 | first;
         }
 
@@ -207,6 +161,7 @@ namespace Cepums {
 
     void MemoryManager::writeWord(uint16_t segment, uint16_t offset, uint16_t value)
     {
+        m_writeCount++;
         uint32_t physical = addresstoPhysical(segment, offset);
 
         // Split into two
@@ -222,23 +177,62 @@ namespace Cepums {
             return;
         }
 
-        // MDA :)
-        if (physical >= 0xB0000 && physical <= 0xB7FFF)
+        // Memory mapped devices
+        if (IODevice* device = getDevice(physical))
         {
-            physical -= 0xB0000;
-            // The address repeats for the entire 32k range
-            while (physical >= m_MDA.size())
-            {
-                physical -= (uint32_t)m_MDA.size();
-            }
-            getMDA().at(physical) = lower;
-            getMDA().at(++physical) = higher;
+            device->writeMemory(physical, lower);
+            device->writeMemory(++physical, higher);
             return;
         }
 
         TODO();
     }
 
+    void MemoryManager::readBlock(uint32_t physical, uint8_t* data, size_t length)
+    {
+        if (physical + length <= m_RAM.size())
+        {
+            std::memcpy(data, m_RAM.data() + physical, length);
+            return;
+        }
+
+        // Anything else goes byte by byte so devices and ROMs see it
+        for (size_t i = 0; i < length; i++)
+        {
+            uint32_t address = (physical + (uint32_t)i) & 0xFFFFF;
+            data[i] = readByte(address >> 4, address & 0xF);
+        }
+    }
+
+    void MemoryManager::writeBlock(uint32_t physical, const uint8_t* data, size_t length)
+    {
+        if (physical + length <= m_RAM.size())
+        {
+            m_writeCount++;
+            std::memcpy(m_RAM.data() + physical, data, length);
+            return;
+        }
+
+        for (size_t i = 0; i < length; i++)
+        {
+            uint32_t address = (physical + (uint32_t)i) & 0xFFFFF;
+            writeByte(address >> 4, address & 0xF, data[i]);
+        }
+    }
+
+    void MemoryManager::registerDevice(IODevice& device)
+    {
+        for (auto& range : device.getMemoryRanges())
+        {
+            DC_CORE_ASSERT((range.first & ((1 << MEMORY_PAGE_SHIFT) - 1)) == 0 && ((range.last + 1) & ((1 << MEMORY_PAGE_SHIFT) - 1)) == 0, "Memory ranges have to be page aligned");
+            for (uint32_t page = range.first >> MEMORY_PAGE_SHIFT; page <= range.last >> MEMORY_PAGE_SHIFT; page++)
+            {
+                DC_CORE_ASSERT(!m_devicePages[page], "Memory is already mapped to a device");
+                m_devicePages[page] = &device;
+            }
+        }
+    }
+
     uint32_t MemoryManager::addresstoPhysical(const uint16_t& segment, const uint16_t& offset)
     {
         uint32_t result = (segment << 4) + offset;
@@ -1,8 +1,15 @@
 #pragma once
 
+#include <array>
 #include <utility>
 #include <vector>
 
+#include "Hardware/IODevice.h"
+
+// Memory mapped devices are looked up by 4K page
+#define MEMORY_PAGE_SHIFT 12
+#define MEMORY_PAGE_COUNT (0x100000 >> MEMORY_PAGE_SHIFT)
+
 namespace Cepums {
 
     class MemoryManager
@@ -16,14 +23,26 @@ namespace Cepums {
         uint16_t readWord(uint16_t segment, uint16_t offset);
         void writeWord(uint16_t segment, uint16_t offset, uint16_t value);
 
+        // Bulk copies at a physical address, for DMA and disk transfers. Runs that stay in RAM are a single copy
+        void readBlock(uint32_t physical, uint8_t* data, size_t length);
+        void writeBlock(uint32_t physical, const uint8_t* data, size_t length);
+
         static uint32_t addresstoPhysical(const uint16_t& segment, const uint16_t& offset);
         std::pair<uint16_t, uint16_t> addressToLogical(const uint32_t& physicalAddress);
-        std::vector<uint8_t>& getMDA() { std::lock_guard<std::mutex> guard(m_MDAmutex); return m_MDA; }
+
+        // Maps the device's memory ranges, which have to start and end on page boundaries
+        void registerDevice(IODevice& device);
+
+        // Number of writes so far, used to tell loops without side effects apart
+        uint64_t getWriteCount() const { return m_writeCount; }
+    private:
+        IODevice* getDevice(uint32_t physical) const { return physical < 0x100000 ? m_devicePages[physical >> MEMORY_PAGE_SHIFT] : nullptr; }
     private:
+        uint64_t m_writeCount = 0;
+
         std::vector<uint8_t> m_RAM;
         std::vector<uint8_t> m_BIOS_F0000;
         std::vector<uint8_t> m_BIOS_F8000;
-        std::vector<uint8_t> m_MDA;
-        std::mutex m_MDAmutex;
+        std::array<IODevice*, MEMORY_PAGE_COUNT> m_devicePages{};
     };
 }
\ No newline at end of file
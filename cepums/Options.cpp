@@ -0,0 +1,266 @@
+#include "cepumspch.h"
+#include "Options.h"
+
+#include "Hardware/FloppyDiskController.h"
+
+namespace Cepums {
+
+    static void printUsage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options]\n"
+            << "  --vsync               Present frames on host vsync instead of the MDA refresh rate\n"
+            << "  --stats <seconds>     Statistics reporting interval, 0 to disable (default: 5)\n"
+            << "  --fast-forward        Run the emulation as fast as possible (toggled with the Pause key)\n"
+            << "  --real-time           Keep the emulation at real speed, also in headless mode\n"
+            << "  --sync-slice <us>     Real time: emulated time run between host clock syncs (default: 1000)\n"
+            << "  --sync-spin <us>      Real time: how long before a sync deadline to stop sleeping and spin (default: 100)\n"
+            << "  --no-idle-skip        Keep executing idle polling loops instead of skipping to the next event\n"
+            << "  --headless            Run without a window, implies --fast-forward\n"
+            << "  --keys <file>         Headless: type the characters in a file, '-' reads from stdin\n"
+            << "  --key-delay <ms>      Headless: time between key presses and releases (default: 50)\n"
+            << "  --screen-dump <file>  Headless: write the screen as text, '-' writes to stdout\n"
+            << "  --framebuffer-dump <file>\n"
+            << "                        Headless: write the screen as a PPM image (needs default-font.bin)\n"
+            << "  --audio-dump <file>   Headless: write the speaker output as a WAV file\n"
+            << "  --dump-interval <ms>  Headless: how often the dumps are refreshed, 0 for exit only (default: 1000)\n"
+            << "  --run-for <seconds>   Headless: stop after this many seconds, 0 runs forever (default: 0)\n"
+            << "  --floppy <file>       Floppy image for the next drive, up to 4 (default: Disk1.img in the first)\n"
+            << "  --floppy-geometry <cylinders>,<heads>,<sectors>\n"
+            << "                        Layout of the floppy images (default: from the image size)\n"
+            << "  --floppy-writes <mode>\n"
+            << "                        What happens to floppy writes: discard, commit (at exit) or write-back\n"
+            << "                        (in the background while running) (default: discard)\n"
+            << "  --hard-disk <file>    Hard disk image (up to 32 MB) on the XT-IDE controller at 300h\n"
+            << "  --hard-disk-writes <mode>\n"
+            << "                        Like --floppy-writes for the hard disk (default: discard)\n"
+            << "  --option-rom <file>   Expansion card ROM at C8000h, like the XT-IDE Universal BIOS for the hard disk\n"
+            << "  --disk-timing <mode>  How long disk operations take: instant, or realistic (seeks, head settling\n"
+            << "                        and rotation like real drives) (default: instant)\n"
+            << "  --hle-disk            Service BIOS INT 13h disk calls directly instead of through the BIOS\n"
+            << "  --help                Show this message\n";
+    }
+
+    // Only takes a whole, non-negative number that fits
+    static bool parseNumber(const std::string& argument, const char* value, unsigned int& number)
+    {
+        try
+        {
+            size_t length;
+            unsigned long parsed = std::stoul(value, &length);
+            if (!std::strchr(value, '-') && value[length] == '\0' && parsed <= UINT_MAX)
+            {
+                number = (unsigned int)parsed;
+                return true;
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            // Not a number at all, or too large for an unsigned long
+        }
+
+        std::cerr << "Invalid value " << value << " for " << argument << ", expected a number\n";
+        return false;
+    }
+
+    static bool parseWriteMode(const char* value, DiskWriteMode& mode)
+    {
+        std::string name = value;
+        if (name == "discard")
+            mode = DiskWriteMode::Discard;
+        else if (name == "commit")
+            mode = DiskWriteMode::Commit;
+        else if (name == "write-back")
+            mode = DiskWriteMode::WriteBack;
+        else
+        {
+            std::cerr << "Invalid write mode " << value << ", expected discard, commit or write-back\n";
+            return false;
+        }
+        return true;
+    }
+
+    bool parseOptions(int argc, char** argv, Options& options)
+    {
+        bool realTime = false;
+        std::vector<std::string> floppyImages;
+
+        for (auto i = 1; i < argc; i++)
+        {
+            std::string argument = argv[i];
+
+            // Fetches the value of options that take one
+            auto nextValue = [&](const char*& value) {
+                if (i + 1 >= argc)
+                {
+                    std::cerr << "Missing value for " << argument << "\n";
+                    return false;
+                }
+                value = argv[++i];
+                return true;
+            };
+            const char* value = nullptr;
+
+            if (argument == "--vsync")
+            {
+                options.vsync = true;
+            }
+            else if (argument == "--stats")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.statsInterval))
+                    return false;
+            }
+            else if (argument == "--fast-forward")
+            {
+                options.fastForward = true;
+            }
+            else if (argument == "--real-time")
+            {
+                realTime = true;
+            }
+            else if (argument == "--sync-slice")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.syncSlice))
+                    return false;
+            }
+            else if (argument == "--sync-spin")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.syncSpin))
+                    return false;
+            }
+            else if (argument == "--no-idle-skip")
+            {
+                options.idleSkip = false;
+            }
+            else if (argument == "--headless")
+            {
+                options.headless = true;
+            }
+            else if (argument == "--keys")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.keyScript = value;
+            }
+            else if (argument == "--key-delay")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.keyDelay))
+                    return false;
+            }
+            else if (argument == "--screen-dump")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.screenDump = value;
+            }
+            else if (argument == "--framebuffer-dump")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.framebufferDump = value;
+            }
+            else if (argument == "--audio-dump")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.audioDump = value;
+            }
+            else if (argument == "--dump-interval")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.dumpInterval))
+                    return false;
+            }
+            else if (argument == "--run-for")
+            {
+                if (!nextValue(value) || !parseNumber(argument, value, options.runFor))
+                    return false;
+            }
+            else if (argument == "--floppy")
+            {
+                if (!nextValue(value))
+                    return false;
+                if (floppyImages.size() == FLOPPY_DRIVE_COUNT)
+                {
+                    std::cerr << "There are only " << FLOPPY_DRIVE_COUNT << " floppy drives\n";
+                    return false;
+                }
+                floppyImages.push_back(value);
+            }
+            else if (argument == "--floppy-geometry")
+            {
+                if (!nextValue(value))
+                    return false;
+
+                DiskGeometry geometry;
+                if (std::sscanf(value, "%u,%u,%u", &geometry.cylinders, &geometry.heads, &geometry.sectorsPerTrack) != 3
+                    || geometry.getSectorCount() == 0)
+                {
+                    std::cerr << "Invalid geometry " << value << ", expected <cylinders>,<heads>,<sectors>\n";
+                    return false;
+                }
+                options.floppyGeometry = geometry;
+            }
+            else if (argument == "--floppy-writes")
+            {
+                if (!nextValue(value) || !parseWriteMode(value, options.floppyWriteMode))
+                    return false;
+            }
+            else if (argument == "--hard-disk")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.hardDiskImage = value;
+            }
+            else if (argument == "--hard-disk-writes")
+            {
+                if (!nextValue(value) || !parseWriteMode(value, options.hardDiskWriteMode))
+                    return false;
+            }
+            else if (argument == "--option-rom")
+            {
+                if (!nextValue(value))
+                    return false;
+                options.optionROM = value;
+            }
+            else if (argument == "--disk-timing")
+            {
+                if (!nextValue(value))
+                    return false;
+
+                std::string name = value;
+                if (name == "instant")
+                    options.diskTiming = DiskTiming::Instant;
+                else if (name == "realistic")
+                    options.diskTiming = DiskTiming::Realistic;
+                else
+                {
+                    std::cerr << "Invalid disk timing " << value << ", expected instant or realistic\n";
+                    return false;
+                }
+            }
+            else if (argument == "--hle-disk")
+                options.diskServicesHLE = true;
+            else if (argument == "--help")
+            {
+                printUsage(argv[0]);
+                return false;
+            }
+            else
+            {
+                std::cerr << "Unknown option " << argument << "\n";
+                printUsage(argv[0]);
+                return false;
+            }
+        }
+
+        if (!floppyImages.empty())
+            options.floppyImages = floppyImages;
+
+        // Nobody is watching a headless machine, so there's no reason to hold it back
+        if (options.headless)
+            options.fastForward = true;
+        if (realTime)
+            options.fastForward = false;
+
+        return true;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Storage/DiskBackend.h"
+#include "Storage/DiskTiming.h"
+
+namespace Cepums {
+
+    // Settings that can be changed from the command line
+    struct Options
+    {
+        // Present frames on host vsync instead of pacing them to the MDA refresh rate
+        bool vsync = false;
+
+        // Print emulator statistics every this many seconds (0 disables them)
+        unsigned int statsInterval = 5;
+
+        // Run emulated time as fast as the host allows instead of following the host clock
+        bool fastForward = false;
+
+        // Real time: length of the emulated slices run between waits for the host clock, and how much
+        // of each wait is spent spinning instead of sleeping (both in microseconds). Shorter slices and more
+        // spinning lower the latency at the cost of host CPU time
+        unsigned int syncSlice = 1000;
+        unsigned int syncSpin = 100;
+
+        // Skip emulated time while the CPU polls an I/O port in a loop that can't change anything
+        bool idleSkip = true;
+
+        // Run without a window. Implies fast-forward unless real time is asked for
+        bool headless = false;
+
+        // Headless: file with characters to type, "-" reads them from stdin
+        std::string keyScript;
+
+        // Headless: how long each key is held down and released for, in milliseconds
+        unsigned int keyDelay = 50;
+
+        // Headless: where to write the screen contents as text ("-" for stdout) and as a PPM image
+        std::string screenDump;
+        std::string framebufferDump;
+
+        // Headless: where to write the speaker output as a WAV file
+        std::string audioDump;
+
+        // Headless: how often the screen dumps are refreshed in milliseconds (0 only dumps at exit)
+        unsigned int dumpInterval = 1000;
+
+        // Headless: stop after this many seconds (0 runs forever)
+        unsigned int runFor = 0;
+
+        // Floppy images for the drives in order, and their layout when it can't be told from the image size
+        std::vector<std::string> floppyImages = { "Disk1.img" };
+        std::optional<DiskGeometry> floppyGeometry;
+
+        // What happens to the guest's floppy writes. By default the image is never modified
+        DiskWriteMode floppyWriteMode = DiskWriteMode::Discard;
+
+        // Hard disk image on the XT-IDE controller (none if empty), its layout comes from its size
+        std::string hardDiskImage;
+        DiskWriteMode hardDiskWriteMode = DiskWriteMode::Discard;
+
+        // ROM of an expansion card at C8000h (none if empty), like the XT-IDE Universal BIOS so the BIOS can boot the hard disk
+        std::string optionROM;
+
+        // How long disk operations take: instant for throughput, or realistic seeks, head settling and rotation
+        DiskTiming diskTiming = DiskTiming::Instant;
+
+        // Service BIOS INT 13h disk calls in C++ instead of running the BIOS's own code
+        bool diskServicesHLE = false;
+    };
+
+    bool parseOptions(int argc, char** argv, Options& options);
+}
@@ -8,6 +8,9 @@
 //  on a real machine as they might just work on an 8086
 //#define STRICT8086INSTRUCTIONSET
 
+// A port read has to repeat with the exact same machine state this many times before the loop counts as idle
+#define IDLE_POLL_REPEATS 16
+
 namespace Cepums {
 
     static bool s_debugSpam = false;
@@ -20,6 +23,9 @@ namespace Cepums {
         m_dataSegment = 0;
         m_stackSegment = 0;
         m_extraSegment = 0;
+        m_halted = false;
+        m_polling = false;
+        m_pollRepeats = 0;
     }
 
     void Processor::execute(MemoryManager& memoryManager, IOManager& io)
@@ -30,6 +36,14 @@ namespace Cepums {
             return;
         }
 
+        // A halted processor only wakes up for an interrupt
+        if (m_halted)
+        {
+            if (IS_BIT_NOT_SET(m_flags, INTERRUPT_ENABLE_FLAG) || !io.hasPendingInterrupts())
+                return;
+            m_halted = false;
+        }
+
         // Increment segment prefix counter if it's being used
         if (m_segmentPrefix != EMPTY_SEGMENT_OVERRIDE)
             m_segmentPrefixCounter++;
@@ -62,6 +76,10 @@ namespace Cepums {
             return ins$INT(memoryManager, interrupt);
         }
 
+        // Calls that get to the BIOS's disk handler are serviced right here, and return to the caller
+        if (m_diskServices && m_diskServicesEntry == MemoryManager::addresstoPhysical(m_codeSegment, m_instructionPointer) && m_diskServices->handleInterrupt(*this))
+            return returnFromDiskServices(memoryManager);
+
         // Debug bootup
         if (m_instructionPointer == 0x7C00) {
             DC_CORE_TRACE("BOOTING FROM SOMETHING YEE HAW");
@@ -1315,8 +1333,10 @@ namespace Cepums {
         }
         case 0x9A: // CALL: FAR_PROC
         {
-            TODO();
-            return;
+            LOAD_NEXT_INSTRUCTION_WORD(memoryManager, instructionPointer);
+            LOAD_NEXT_INSTRUCTION_WORD(memoryManager, codeSegment);
+
+            return ins$CALLfar(memoryManager, codeSegment, instructionPointer);
         }
         case 0x9B: // WAIT: Wait
         {
@@ -1591,8 +1611,7 @@ namespace Cepums {
         }
         case 0xCB: // RET: Return intersegment
         {
-            TODO();
-            return;
+            return ins$RETfarAddImmediateToSP(memoryManager, 0);
         }
         case 0xCC: // INT: Interrupt 3
         {
@@ -1608,6 +1627,11 @@ namespace Cepums {
             }
             if (immediate == 0x13)
             {
+                // Only trust the vector while it's still pointing at the BIOS ROM
+                uint16_t handlerSegment = memoryManager.readWord(0, 0x13 * 4 + 2);
+                if (m_diskServices && m_diskServicesEntry == 0 && handlerSegment >= 0xF000)
+                    m_diskServicesEntry = MemoryManager::addresstoPhysical(handlerSegment, memoryManager.readWord(0, 0x13 * 4));
+
                 DC_CORE_TRACE("int13: AH={0:x} ", AH());
                 //TODO();
                 //s_debugSpam = true;
@@ -1919,11 +1943,15 @@ namespace Cepums {
             INSTRUCTION_TRACE("ins$IN: Data from port immediate into AL");
             LOAD_NEXT_INSTRUCTION_BYTE(memoryManager, data);
             AL(io.readByte(data));
+            notePortRead(memoryManager, io, data);
             return;
         }
-        case 0xE5: // IN: 8-bit immediate and AX ??
+        case 0xE5: // IN: 8-bit immediate and AX
         {
-            TODO();
+            INSTRUCTION_TRACE("ins$IN: 16-bit data from port immediate into AX");
+            LOAD_NEXT_INSTRUCTION_BYTE(memoryManager, data);
+            AX() = io.readWord(data);
+            notePortRead(memoryManager, io, data);
             return;
         }
         case 0xE6: // OUT: 8-bit immediate and AL
@@ -1966,12 +1994,14 @@ namespace Cepums {
         {
             INSTRUCTION_TRACE("ins$IN: 8-bit data from port DX into AL");
             AL(io.readByte(DX()));
+            notePortRead(memoryManager, io, DX());
             return;
         }
         case 0xED: // IN: AX and DX
         {
             INSTRUCTION_TRACE("ins$IN: 16-bit data from port DX into AX");
             AX() = io.readWord(DX());
+            notePortRead(memoryManager, io, DX());
             return;
         }
         case 0xEE: // OUT: AL and DX
@@ -1982,8 +2012,8 @@ namespace Cepums {
         }
         case 0xEF: // OUT: AX and DX
         {
-            TODO();
-            // TODO: This needs to do 16-bit transfers I think
+            INSTRUCTION_TRACE("ins$OUT: AX to port in DX");
+            io.writeWord(DX(), AX());
             return;
         }
         case 0xF0: // LOCK: Lock bus
@@ -2245,8 +2275,7 @@ namespace Cepums {
             case 0b010: // CALL: Intrasegment
                 return ins$CALLnearFromMemory(memoryManager, segment, effectiveAddress);
             case 0b011: // CALL: Intersegment
-                TODO();
-                return;
+                return ins$CALLfarFromMemory(memoryManager, segment, effectiveAddress);
             case 0b100: // JMP: Intrasegment
                 return ins$JMPnearFromMemory(memoryManager, segment, effectiveAddress);
             case 0b101:
@@ -2296,10 +2325,63 @@ namespace Cepums {
         }
     }
 
+    void Processor::returnFromDiskServices(MemoryManager& memoryManager)
+    {
+        // Like the BIOS's RETF 2: back to the caller with interrupts enabled and the carry flag as it was set
+        m_instructionPointer = memoryManager.readWord(SS(), SP());
+        m_codeSegment = memoryManager.readWord(SS(), SP() + 2);
+        SP() += 6;
+        SET_FLAG_BIT(m_flags, INTERRUPT_ENABLE_FLAG);
+    }
+
+    bool Processor::isIdle(IOManager& io) const
+    {
+        // An interrupt would be taken right away
+        if (IS_BIT_SET(m_flags, INTERRUPT_ENABLE_FLAG) && io.hasPendingInterrupts())
+            return false;
+
+        return m_halted || m_polling;
+    }
+
+    std::optional<uint16_t> Processor::getPolledPort() const
+    {
+        if (m_halted || !m_polling)
+            return std::nullopt;
+        return m_pollState.back();
+    }
+
+    void Processor::notePortRead(MemoryManager& memoryManager, IOManager& io, uint16_t port)
+    {
+        if (!m_detectIdleLoops)
+            return;
+
+        // Everything the next loop iteration could depend on, including the value that was just read
+        std::array<uint16_t, 15> state = {
+            m_codeSegment, m_instructionPointer, m_dataSegment, m_stackSegment, m_extraSegment,
+            m_AX, m_BX, m_CX, m_DX, m_stackPointer, m_basePointer, m_sourceIndex, m_destinationIndex,
+            m_flags, port
+        };
+
+        // Coming back to the same read in the same state without having written anything means the loop
+        // will keep doing exactly this until the port returns something else
+        if (state == m_pollState && memoryManager.getWriteCount() == m_pollMemoryWrites && io.getWriteCount() == m_pollIOWrites)
+        {
+            if (++m_pollRepeats >= IDLE_POLL_REPEATS)
+                m_polling = true;
+            return;
+        }
+
+        m_pollState = state;
+        m_pollMemoryWrites = memoryManager.getWriteCount();
+        m_pollIOWrites = io.getWriteCount();
+        m_pollRepeats = 0;
+        m_polling = false;
+    }
+
     void Processor::ins$HLT()
     {
         INSTRUCTION_TRACE("ins$HLT: Halting");
-        TODO();
+        m_halted = true;
     }
 
     void Processor::ins$CLC()
@@ -2387,8 +2469,6 @@ namespace Cepums {
             if (destination->valueByte(this, mm) > UCHAR_MAX - source->valueByte(this, mm) - carryFlag)
             {
                 SET_FLAG_BIT(m_flags, CARRY_FLAG);
-                // Fix UB
-                result = (UCHAR_MAX - source->valueByte(this, mm)) + destination->valueByte(this, mm) + carryFlag;
             }
             else
             {
@@ -2414,8 +2494,6 @@ namespace Cepums {
             if (destination->valueWord(this, mm) > USHRT_MAX - source->valueWord(this, mm) - carryFlag)
             {
                 SET_FLAG_BIT(m_flags, CARRY_FLAG);
-                // Fix UB
-                result = (USHRT_MAX - source->valueWord(this, mm)) + destination->valueWord(this, mm) + carryFlag;
             }
             else
             {
@@ -2448,8 +2526,6 @@ namespace Cepums {
             if (destination->valueByte(this, mm) > UCHAR_MAX - source->valueByte(this, mm))
             {
                 SET_FLAG_BIT(m_flags, CARRY_FLAG);
-                // Fix UB
-                result = (UCHAR_MAX - source->valueByte(this, mm)) + destination->valueByte(this, mm);
             }
             else
             {
@@ -2474,8 +2550,6 @@ namespace Cepums {
             if (destination->valueWord(this, mm) > USHRT_MAX - source->valueWord(this, mm))
             {
                 SET_FLAG_BIT(m_flags, CARRY_FLAG);
-                // Fix UB
-                result = (USHRT_MAX - source->valueWord(this, mm)) + destination->valueWord(this, mm);
             }
             else
             {
@@ -2534,6 +2608,28 @@ namespace Cepums {
         INSTRUCTION_TRACE("ins$CALL: near to {0:X}:{1:X}", segment, IP());
     }
 
+    void Processor::ins$CALLfar(MemoryManager& memoryManager, uint16_t newCodeSegment, uint16_t newInstructionPointer)
+    {
+        INSTRUCTION_TRACE("ins$CALL: far to {0:X}:{1:X}", newCodeSegment, newInstructionPointer);
+        SP() -= 2;
+        memoryManager.writeWord(SS(), SP(), CS());
+        SP() -= 2;
+        memoryManager.writeWord(SS(), SP(), IP());
+        CS() = newCodeSegment;
+        IP() = newInstructionPointer;
+    }
+
+    void Processor::ins$CALLfarFromMemory(MemoryManager& memoryManager, uint16_t segment, uint16_t effectiveAddress)
+    {
+        if (m_segmentPrefix != EMPTY_SEGMENT_OVERRIDE)
+            segment = getSegmentRegisterValueAndResetOverride();
+
+        // The offset comes first, then the segment
+        uint16_t newInstructionPointer = memoryManager.readWord(segment, effectiveAddress);
+        uint16_t newCodeSegment = memoryManager.readWord(segment, effectiveAddress + 2);
+        ins$CALLfar(memoryManager, newCodeSegment, newInstructionPointer);
+    }
+
     void Processor::ins$CBW()
     {
         INSTRUCTION_TRACE("ins$CBW: Sign-extend AL into AX");
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+
 #include "Immediate.h"
 #include "IOManager.h"
 #include "Memory.h"
@@ -91,6 +93,18 @@ namespace Cepums {
         void reset();
         void execute(MemoryManager& memoryManager, IOManager& io);
 
+        // True when nothing changes until a device event or an interrupt: the CPU is halted, or is polling
+        // an I/O port in a loop whose iterations only depend on the value that's read
+        bool isIdle(IOManager& io) const;
+        void wakeFromPolling() { m_polling = false; }
+
+        // The port an idle polling loop is waiting on, if that's why the CPU is idle
+        std::optional<uint16_t> getPolledPort() const;
+        void setIdleLoopDetection(bool enabled) { m_detectIdleLoops = enabled; }
+
+        // Run BIOS disk calls through these instead of the BIOS's own code, nullptr turns that off
+        void setDiskServices(DiskServices* diskServices) { m_diskServices = diskServices; }
+
         // Large pile of instructions
         void ins$HLT();
         void ins$CLC();
@@ -113,6 +127,8 @@ namespace Cepums {
 
         void ins$CALLnear(MemoryManager& memoryManager, int16_t offset);
         void ins$CALLnearFromMemory(MemoryManager& memoryManager, uint16_t segment, uint16_t effectiveAddress);
+        void ins$CALLfar(MemoryManager& memoryManager, uint16_t newCodeSegment, uint16_t newInstructionPointer);
+        void ins$CALLfarFromMemory(MemoryManager& memoryManager, uint16_t segment, uint16_t effectiveAddress);
 
         void ins$CBW();
 
@@ -252,10 +268,27 @@ namespace Cepums {
         void setFlagsAfterArithmeticOperation(uint16_t word);
 
         bool hasSegmentOverridePrefix();
+    private:
+        void notePortRead(MemoryManager& memoryManager, IOManager& io, uint16_t port);
+        void returnFromDiskServices(MemoryManager& memoryManager);
     private:
         int m_cyclesToWait = 0;
         int m_currentCycleCounter = 0;
         uint16_t m_internalInterrupt = 0;
+        bool m_halted = false;
+
+        // Idle loop detection: the state after the last port read, and how many times in a row it repeated
+        bool m_detectIdleLoops = true;
+        bool m_polling = false;
+        unsigned int m_pollRepeats = 0;
+        std::array<uint16_t, 15> m_pollState{};
+        uint64_t m_pollMemoryWrites = 0;
+        uint64_t m_pollIOWrites = 0;
+
+        // Disk services HLE. The BIOS's INT 13h handler is found from the vector the first time the
+        // interrupt is raised, so calls chained to it by DOS are caught as well
+        DiskServices* m_diskServices = nullptr;
+        uint32_t m_diskServicesEntry = 0;
 
         uint8_t m_segmentPrefix = EMPTY_SEGMENT_OVERRIDE;
         uint8_t m_segmentPrefixCounter = 0;
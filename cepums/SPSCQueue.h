@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace Cepums {
+
+    // Bounded lock-free queue for exactly one producer thread and one consumer thread.
+    // Capacity has to be a power of two
+    template<typename T, size_t Capacity>
+    class SPSCQueue
+    {
+        static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+    public:
+        // Producer side. Returns false if the queue is full
+        bool push(const T& item)
+        {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_tail.load(std::memory_order_acquire) == Capacity)
+                return false;
+
+            m_items[head & (Capacity - 1)] = item;
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer side. Returns false if the queue is empty
+        bool pop(T& item)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail == m_head.load(std::memory_order_acquire))
+                return false;
+
+            item = m_items[tail & (Capacity - 1)];
+            m_tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Either side. Only a snapshot, the other thread can change it right after
+        size_t size() const { return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire); }
+    private:
+        // Kept on separate cache lines so the two threads don't fight over them
+        alignas(64) std::atomic<size_t> m_head{ 0 };
+        alignas(64) std::atomic<size_t> m_tail{ 0 };
+        std::array<T, Capacity> m_items;
+    };
+}
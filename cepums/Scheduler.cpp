@@ -0,0 +1,70 @@
+#include "cepumspch.h"
+#include "Scheduler.h"
+
+namespace Cepums {
+
+    EventID Scheduler::registerEvent(const char* name, std::function<void()> callback)
+    {
+        Event event;
+        event.name = name;
+        event.callback = std::move(callback);
+        m_events.push_back(std::move(event));
+        return m_events.size() - 1;
+    }
+
+    void Scheduler::schedule(EventID event, uint64_t time)
+    {
+        // Devices are asked again after every port access, usually nothing has moved. Pushing another heap
+        // entry for that would only leave stale ones behind
+        Event& entry = m_events[event];
+        if (entry.time == time)
+            return;
+
+        entry.time = time;
+        entry.generation++;
+        m_queue.push({ time, event, entry.generation });
+
+        if (time < m_nextDeadline)
+            m_nextDeadline = time;
+    }
+
+    void Scheduler::cancel(EventID event)
+    {
+        Event& entry = m_events[event];
+        if (entry.time == NO_EVENT)
+            return;
+
+        entry.time = NO_EVENT;
+        entry.generation++;
+        updateNextDeadline();
+    }
+
+    void Scheduler::runDueEvents()
+    {
+        while (!m_queue.empty() && m_queue.top().time <= m_now)
+        {
+            QueueEntry top = m_queue.top();
+            m_queue.pop();
+
+            // Skip entries of events that have been moved or cancelled since
+            Event& entry = m_events[top.event];
+            if (top.generation != entry.generation)
+                continue;
+
+            entry.time = NO_EVENT;
+            m_eventTime = top.time;
+            entry.callback();
+        }
+
+        updateNextDeadline();
+    }
+
+    void Scheduler::updateNextDeadline()
+    {
+        // Drop stale entries so the top is always a live event
+        while (!m_queue.empty() && m_queue.top().generation != m_events[m_queue.top().event].generation)
+            m_queue.pop();
+
+        m_nextDeadline = m_queue.empty() ? NO_EVENT : m_queue.top().time;
+    }
+}
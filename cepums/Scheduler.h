@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <vector>
+
+#include "Clock.h"
+
+#define NO_EVENT UINT64_MAX
+
+namespace Cepums {
+
+    using EventID = size_t;
+
+    // Keeps emulated time (in master clock ticks) and the device events that are due at some point in it.
+    // Devices register a callback once and then (re)schedule it for an absolute time,
+    // so the CPU can run without interruption until the earliest deadline
+    class Scheduler
+    {
+    public:
+        EventID registerEvent(const char* name, std::function<void()> callback);
+
+        // Scheduling an event that's already pending moves it, scheduling it for the time it's already at does nothing
+        void schedule(EventID event, uint64_t time);
+        void scheduleIn(EventID event, uint64_t delay) { schedule(event, m_now + delay); }
+        void cancel(EventID event);
+        bool isScheduled(EventID event) const { return m_events[event].time != NO_EVENT; }
+
+        uint64_t now() const { return m_now; }
+        void advance(uint64_t ticks) { m_now += ticks; }
+        void advanceTo(uint64_t time) { m_now = time; }
+
+        // The time the running event was due at. Periodic events reschedule relative to it rather than
+        // to now() so they don't drift when they run a little late
+        uint64_t eventTime() const { return m_eventTime; }
+
+        // Time of the earliest pending event (NO_EVENT if there's none)
+        uint64_t nextDeadline() const { return m_nextDeadline; }
+
+        // Runs every event that's due by now, including ones scheduled by the callbacks themselves
+        void runDueEvents();
+    private:
+        struct Event
+        {
+            const char* name;
+            std::function<void()> callback;
+            uint64_t time = NO_EVENT;
+            uint64_t generation = 0;
+        };
+
+        // Moving or cancelling an event leaves its old heap entry behind, the generation tells them apart
+        struct QueueEntry
+        {
+            uint64_t time;
+            EventID event;
+            uint64_t generation;
+
+            bool operator>(const QueueEntry& other) const { return time > other.time; }
+        };
+
+        void updateNextDeadline();
+    private:
+        uint64_t m_now = 0;
+        uint64_t m_nextDeadline = NO_EVENT;
+        uint64_t m_eventTime = 0;
+
+        std::vector<Event> m_events;
+        std::priority_queue<QueueEntry, std::vector<QueueEntry>, std::greater<QueueEntry>> m_queue;
+    };
+}
@@ -0,0 +1,62 @@
+#include "cepumspch.h"
+#include "Stats.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <SDL.h>
+
+namespace Cepums {
+
+    uint64_t getThreadCPUTime()
+    {
+#ifdef _WIN32
+        FILETIME creation, exit, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+            return 0;
+
+        // FILETIMEs are in 100 ns units
+        uint64_t kernelTime = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+        uint64_t userTime = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+        return (kernelTime + userTime) / 10;
+#else
+        timespec time;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+            return 0;
+        return (uint64_t)time.tv_sec * 1000 * 1000 + time.tv_nsec / 1000;
+#endif
+    }
+
+    Stats::Stats(unsigned int interval)
+        : m_interval(interval * SDL_GetPerformanceFrequency())
+        , m_lastReport(SDL_GetPerformanceCounter())
+        , m_lastRenderCPUTime(getThreadCPUTime())
+    {
+    }
+
+    void Stats::update()
+    {
+        if (m_interval == 0)
+            return;
+
+        uint64_t now = SDL_GetPerformanceCounter();
+        if (now - m_lastReport < m_interval)
+            return;
+
+        double elapsed = (double)(now - m_lastReport) / SDL_GetPerformanceFrequency(); // This is in seconds
+        uint64_t renderCPUTime = getThreadCPUTime();
+        double renderCPUSeconds = (double)(renderCPUTime - m_lastRenderCPUTime) / (1000 * 1000);
+
+        DC_CORE_INFO("[Stats]: {0:.1f} fps, render thread CPU {1:.1f} ms/s ({2:.1f}%)",
+            m_frames / elapsed, renderCPUSeconds * 1000 / elapsed, renderCPUSeconds * 100 / elapsed);
+
+        m_lastReport = now;
+        m_lastRenderCPUTime = renderCPUTime;
+        m_frames = 0;
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Cepums {
+
+    // CPU time consumed by the calling thread, in microseconds
+    uint64_t getThreadCPUTime();
+
+    class Stats
+    {
+    public:
+        Stats(unsigned int interval);
+
+        // Called by the render thread once per presented frame
+        void frameRendered() { m_frames++; }
+
+        // Prints and resets the counters if the reporting interval has passed. Has to be called from the render thread
+        void update();
+    private:
+        uint64_t m_interval;
+        uint64_t m_lastReport;
+        uint64_t m_lastRenderCPUTime;
+        uint64_t m_frames = 0;
+    };
+}
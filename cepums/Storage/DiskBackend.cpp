@@ -0,0 +1,432 @@
+#include "cepumspch.h"
+#include "DiskBackend.h"
+
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Write-back: how long the flush thread lets writes pile up before it writes them out, in milliseconds
+#define WRITE_BACK_DELAY 100
+
+#define JOURNAL_MAGIC 0x4C4E4A43 // "CJNL"
+
+// Each journal entry is the LBA followed by the sector
+#define JOURNAL_ENTRY_SIZE (sizeof(uint64_t) + SECTOR_SIZE)
+
+namespace Cepums {
+
+    struct JournalHeader
+    {
+        uint32_t magic;
+        uint32_t sectorCount;
+        uint64_t checksum; // Of everything after the header
+    };
+
+    struct FileRun
+    {
+        uint64_t offset;
+        const uint8_t* data;
+        size_t length;
+    };
+
+    // FNV-1a
+    static uint64_t checksum(const uint8_t* data, size_t length)
+    {
+        uint64_t hash = 0xCBF29CE484222325;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash ^= data[i];
+            hash *= 0x100000001B3;
+        }
+        return hash;
+    }
+
+    // Writes the runs and waits for them to reach the disk
+#ifdef _WIN32
+    static bool writeDurably(const std::string& path, const std::vector<FileRun>& runs, bool create)
+    {
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+
+        bool written = true;
+        for (auto& run : runs)
+        {
+            OVERLAPPED position = {};
+            position.Offset = (DWORD)run.offset;
+            position.OffsetHigh = (DWORD)(run.offset >> 32);
+            DWORD done = 0;
+            if (!WriteFile(file, run.data, (DWORD)run.length, &done, &position) || done != run.length)
+            {
+                written = false;
+                break;
+            }
+        }
+
+        written = written && FlushFileBuffers(file);
+        CloseHandle(file);
+        return written;
+    }
+#else
+    static bool writeDurably(const std::string& path, const std::vector<FileRun>& runs, bool create)
+    {
+        int file = ::open(path.c_str(), create ? O_WRONLY | O_CREAT | O_TRUNC : O_WRONLY, 0644);
+        if (file < 0)
+            return false;
+
+        bool written = true;
+        for (auto& run : runs)
+        {
+            size_t done = 0;
+            while (written && done < run.length)
+            {
+                ssize_t result = pwrite(file, run.data + done, run.length - done, (off_t)(run.offset + done));
+                if (result <= 0)
+                    written = false;
+                else
+                    done += (size_t)result;
+            }
+        }
+
+        written = written && fsync(file) == 0;
+        ::close(file);
+        return written;
+    }
+#endif
+
+    DiskBackend::~DiskBackend()
+    {
+        close();
+    }
+
+    bool DiskBackend::open(const std::string& path, const DiskGeometry& geometry, DiskWriteMode writeMode)
+    {
+        close();
+
+        // A journal left behind means the last run crashed in the middle of a flush
+        m_journalPath = path + ".journal";
+        replayJournal(path);
+
+        if (!m_image.open(path, geometry))
+            return false;
+
+        m_writeMode = writeMode;
+        m_writeGeneration = 0;
+        if (m_writeMode == DiskWriteMode::WriteBack)
+        {
+            m_flushedGeneration = 0;
+            m_flushFailed = false;
+            m_stopping = false;
+            m_flushThread = std::thread([this] { flushLoop(); });
+        }
+        return true;
+    }
+
+    void DiskBackend::close()
+    {
+        if (!m_image.isOpen())
+            return;
+        waitForPreload();
+
+        if (m_writeMode == DiskWriteMode::WriteBack)
+        {
+            // The flush thread writes out whatever is left before it stops
+            {
+                std::lock_guard lock(m_mutex);
+                m_stopping = true;
+            }
+            m_flushCondition.notify_one();
+            m_flushThread.join();
+        }
+        else if (m_writeMode == DiskWriteMode::Commit)
+        {
+            commit();
+        }
+        else if (!m_overlay.empty())
+        {
+            DC_CORE_INFO("[DiskBackend]: Discarding {0} written sectors of {1}", m_overlay.size(), m_image.getPath());
+        }
+
+        m_overlay.clear();
+        m_dirty.clear();
+        m_image.close();
+    }
+
+    const uint8_t* DiskBackend::getSector(size_t lba) const
+    {
+        // The flush thread looks into the overlay too. The sector itself is safe to use after the lock is gone:
+        // map nodes don't move, and only this thread writes or removes them
+        {
+            std::lock_guard lock(m_mutex);
+            auto written = m_overlay.find(lba);
+            if (written != m_overlay.end())
+                return written->second.data();
+        }
+
+        if (m_image.getAvailableSectors(lba, 1) == 0)
+            return nullptr;
+        return m_image.getSectors(lba);
+    }
+
+    void DiskBackend::readSectors(size_t lba, size_t count, uint8_t* data) const
+    {
+        for (size_t i = 0; i < count; i++, data += SECTOR_SIZE)
+        {
+            const uint8_t* sector = getSector(lba + i);
+            if (sector)
+                memcpy(data, sector, SECTOR_SIZE);
+            else
+                memset(data, 0, SECTOR_SIZE);
+        }
+    }
+
+    bool DiskBackend::writeSectors(size_t lba, size_t count, const uint8_t* data)
+    {
+        if (lba + count > m_image.getGeometry().getSectorCount())
+            return false;
+
+        {
+            std::lock_guard lock(m_mutex);
+            for (size_t i = 0; i < count; i++)
+                memcpy(m_overlay[lba + i].data(), data + i * SECTOR_SIZE, SECTOR_SIZE);
+            m_writeGeneration++;
+            if (m_writeMode != DiskWriteMode::WriteBack)
+                return true;
+
+            for (size_t i = 0; i < count; i++)
+                m_dirty.insert(lba + i);
+        }
+        m_flushCondition.notify_one();
+        return true;
+    }
+
+    void DiskBackend::discard()
+    {
+        std::lock_guard lock(m_mutex);
+        m_overlay.clear();
+        m_dirty.clear();
+    }
+
+    void DiskBackend::preload()
+    {
+        if (!m_image.isOpen() || m_preloadThread.joinable())
+            return;
+        m_preloadThread = std::thread([this] { m_image.prefetch(); });
+    }
+
+    void DiskBackend::waitForPreload()
+    {
+        if (m_preloadThread.joinable())
+            m_preloadThread.join();
+    }
+
+    bool DiskBackend::commit()
+    {
+        // Write-back keeps the image up to date on its own
+        if (m_writeMode == DiskWriteMode::WriteBack)
+            return sync();
+
+        if (m_overlay.empty())
+            return true;
+        waitForPreload();
+
+        // The base stays mapped read-only. The shared mapping picks the new contents up from the page cache
+        std::fstream file(m_image.getPath(), std::ios::in | std::ios::out | std::ios::binary);
+        if (!file)
+        {
+            DC_CORE_ERROR("[DiskBackend]: Can't open {0} to commit {1} written sectors", m_image.getPath(), m_overlay.size());
+            return false;
+        }
+
+        // Sectors past the end of the file grow it, and the mapping has to be redone to see them
+        bool grows = m_image.getAvailableSectors(m_overlay.rbegin()->first, 1) == 0;
+
+        for (auto& [lba, sector] : m_overlay)
+        {
+            file.seekp((std::streamoff)lba * SECTOR_SIZE);
+            file.write((const char*)sector.data(), SECTOR_SIZE);
+        }
+
+        file.flush();
+        if (!file)
+        {
+            DC_CORE_ERROR("[DiskBackend]: Committing to {0} failed", m_image.getPath());
+            return false;
+        }
+
+        DC_CORE_INFO("[DiskBackend]: Committed {0} written sectors to {1}", m_overlay.size(), m_image.getPath());
+        m_overlay.clear();
+
+        if (grows)
+        {
+            file.close();
+            std::string path = m_image.getPath();
+            return m_image.open(path, m_image.getGeometry());
+        }
+        return true;
+    }
+
+    bool DiskBackend::sync() const
+    {
+        if (m_writeMode != DiskWriteMode::WriteBack)
+            return true;
+
+        std::unique_lock lock(m_mutex);
+        uint64_t target = m_writeGeneration;
+        if (m_flushedGeneration >= target)
+            return true;
+
+        m_syncRequested = true;
+        m_flushCondition.notify_one();
+        m_syncCondition.wait(lock, [&] { return m_flushedGeneration >= target || m_flushFailed; });
+        return m_flushedGeneration >= target;
+    }
+
+    void DiskBackend::flushLoop()
+    {
+        std::unique_lock lock(m_mutex);
+        while (true)
+        {
+            m_flushCondition.wait(lock, [this] { return m_stopping || m_syncRequested || !m_dirty.empty(); });
+
+            // Give the rest of a burst of writes (FAT copies, directory updates) a chance to join the batch
+            if (!m_stopping && !m_syncRequested)
+                m_flushCondition.wait_for(lock, std::chrono::milliseconds(WRITE_BACK_DELAY), [this] { return m_stopping || m_syncRequested; });
+            m_syncRequested = false;
+
+            if (m_dirty.empty())
+            {
+                if (m_stopping)
+                    break;
+                continue;
+            }
+
+            // Copy the batch out so the emulation thread can keep writing while it goes to disk
+            uint64_t generation = m_writeGeneration;
+            std::vector<size_t> sectors(m_dirty.begin(), m_dirty.end());
+            // Through a const reference, so looking a sector up can never insert one
+            const auto& overlay = m_overlay;
+            std::vector<uint8_t> data(sectors.size() * SECTOR_SIZE);
+            for (size_t i = 0; i < sectors.size(); i++)
+            {
+                auto sector = overlay.find(sectors[i]);
+                DC_CORE_ASSERT(sector != overlay.end(), "Dirty sector missing from the overlay");
+                memcpy(&data[i * SECTOR_SIZE], sector->second.data(), SECTOR_SIZE);
+            }
+            m_dirty.clear();
+
+            lock.unlock();
+            bool flushed = flush(sectors, data);
+            lock.lock();
+
+            if (flushed)
+            {
+                m_flushedGeneration = generation;
+                m_flushFailed = false;
+            }
+            else
+            {
+                DC_CORE_ERROR("[DiskBackend]: Flushing {0} sectors to {1} failed", sectors.size(), m_image.getPath());
+                m_flushFailed = true;
+                m_dirty.insert(sectors.begin(), sectors.end());
+            }
+            m_syncCondition.notify_all();
+
+            if (m_stopping && (m_dirty.empty() || !flushed))
+                break;
+
+            // Don't hammer a failing disk
+            if (!flushed)
+                m_flushCondition.wait_for(lock, std::chrono::milliseconds(WRITE_BACK_DELAY), [this] { return m_stopping; });
+        }
+
+        if (!m_dirty.empty())
+            DC_CORE_ERROR("[DiskBackend]: {0} written sectors never made it to {1}", m_dirty.size(), m_image.getPath());
+    }
+
+    bool DiskBackend::flush(const std::vector<size_t>& sectors, const std::vector<uint8_t>& data)
+    {
+        // Journal first, so the image is never left half written
+        std::vector<uint8_t> journal(sizeof(JournalHeader) + sectors.size() * JOURNAL_ENTRY_SIZE);
+        uint8_t* entry = journal.data() + sizeof(JournalHeader);
+        for (size_t i = 0; i < sectors.size(); i++, entry += JOURNAL_ENTRY_SIZE)
+        {
+            uint64_t lba = sectors[i];
+            memcpy(entry, &lba, sizeof(lba));
+            memcpy(entry + sizeof(lba), &data[i * SECTOR_SIZE], SECTOR_SIZE);
+        }
+
+        JournalHeader header = { JOURNAL_MAGIC, (uint32_t)sectors.size(), 0 };
+        header.checksum = checksum(journal.data() + sizeof(JournalHeader), journal.size() - sizeof(JournalHeader));
+        memcpy(journal.data(), &header, sizeof(header));
+
+        if (!writeDurably(m_journalPath, { { 0, journal.data(), journal.size() } }, true))
+            return false;
+
+        // Then the image, one write for each run of neighbouring sectors on a track
+        unsigned int sectorsPerTrack = m_image.getGeometry().sectorsPerTrack;
+        std::vector<FileRun> runs;
+        for (size_t i = 0; i < sectors.size(); i++)
+        {
+            bool continues = !runs.empty() && sectors[i] == sectors[i - 1] + 1 && sectors[i] % sectorsPerTrack != 0;
+            if (continues)
+                runs.back().length += SECTOR_SIZE;
+            else
+                runs.push_back({ (uint64_t)sectors[i] * SECTOR_SIZE, &data[i * SECTOR_SIZE], SECTOR_SIZE });
+        }
+
+        // A journal that stays behind is replayed on the next open
+        if (!writeDurably(m_image.getPath(), runs, false))
+            return false;
+
+        std::remove(m_journalPath.c_str());
+        return true;
+    }
+
+    void DiskBackend::replayJournal(const std::string& path)
+    {
+        std::ifstream file(m_journalPath, std::ios::binary);
+        if (!file)
+            return;
+
+        std::vector<uint8_t> journal((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+
+        // A journal that's torn or damaged never got as far as the image, which is still consistent
+        JournalHeader header = {};
+        if (journal.size() >= sizeof(header))
+            memcpy(&header, journal.data(), sizeof(header));
+        if (header.magic != JOURNAL_MAGIC || journal.size() != sizeof(header) + header.sectorCount * JOURNAL_ENTRY_SIZE
+            || header.checksum != checksum(journal.data() + sizeof(header), journal.size() - sizeof(header)))
+        {
+            DC_CORE_WARN("[DiskBackend]: Dropping incomplete journal {0}", m_journalPath);
+            std::remove(m_journalPath.c_str());
+            return;
+        }
+
+        std::vector<FileRun> runs;
+        const uint8_t* entry = journal.data() + sizeof(header);
+        for (uint32_t i = 0; i < header.sectorCount; i++, entry += JOURNAL_ENTRY_SIZE)
+        {
+            uint64_t lba;
+            memcpy(&lba, entry, sizeof(lba));
+            runs.push_back({ lba * SECTOR_SIZE, entry + sizeof(lba), SECTOR_SIZE });
+        }
+
+        if (!writeDurably(path, runs, false))
+        {
+            DC_CORE_ERROR("[DiskBackend]: Can't replay journal {0}", m_journalPath);
+            return;
+        }
+
+        DC_CORE_INFO("[DiskBackend]: Replayed {0} sectors from journal {1}", header.sectorCount, m_journalPath);
+        std::remove(m_journalPath.c_str());
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "DiskImage.h"
+
+namespace Cepums {
+
+    // What happens to the guest's writes
+    enum class DiskWriteMode
+    {
+        Discard, // Dropped when the disk is closed
+        Commit, // Written into the image when the disk is closed
+        WriteBack // Written into the image in the background while running
+    };
+
+    // The disk as the guest sees it: a base image mapped read-only, so every instance shares the same pages,
+    // with the guest's writes kept in a sparse overlay of their own. The base file is only touched by a commit,
+    // or by the flush thread in write-back mode.
+    // getSector and writeSector belong to the emulation thread, sync can be called from anywhere
+    class DiskBackend
+    {
+    public:
+        DiskBackend() = default;
+        ~DiskBackend();
+
+        DiskBackend(const DiskBackend&) = delete;
+        DiskBackend& operator=(const DiskBackend&) = delete;
+
+        bool open(const std::string& path, const DiskGeometry& geometry, DiskWriteMode writeMode);
+        void close();
+
+        bool isOpen() const { return m_image.isOpen(); }
+        const std::string& getPath() const { return m_image.getPath(); }
+        const DiskGeometry& getGeometry() const { return m_image.getGeometry(); }
+        size_t toLBA(unsigned int cylinder, unsigned int head, unsigned int sector) const { return m_image.toLBA(cylinder, head, sector); }
+
+        // A sector's current contents, or nullptr if it was never written and the image is too short to have it
+        const uint8_t* getSector(size_t lba) const;
+
+        // Copies count sectors, missing ones read as zeroes
+        void readSectors(size_t lba, size_t count, uint8_t* data) const;
+
+        // Return false outside of the geometry
+        bool writeSector(size_t lba, const uint8_t* data) { return writeSectors(lba, 1, data); }
+        bool writeSectors(size_t lba, size_t count, const uint8_t* data);
+
+        // Goes up with every write, so a copy of the contents can tell it's out of date
+        uint64_t getWriteGeneration() const { return m_writeGeneration; }
+
+        // Forget the guest's writes, or write them into the base image
+        void discard();
+        bool commit();
+
+        // Write-back: blocks until every write made so far is in the image, returns false if flushing failed
+        bool sync() const;
+
+        // Reads the whole image into memory on a background thread, so the guest's first access doesn't wait for it
+        void preload();
+    private:
+        void waitForPreload();
+        void flushLoop();
+        bool flush(const std::vector<size_t>& sectors, const std::vector<uint8_t>& data);
+        void replayJournal(const std::string& path);
+    private:
+        DiskImage m_image;
+        DiskWriteMode m_writeMode = DiskWriteMode::Discard;
+
+        // Written sectors by LBA, in order so a commit writes the file front to back.
+        // Flushed sectors stay in it, it never holds more than the disk.
+        // The emulation thread owns it and is the only one that adds, changes or removes sectors. While the
+        // flush thread runs it only reads the overlay, under m_mutex, and the emulation thread changes it under m_mutex too
+        std::map<size_t, std::array<uint8_t, SECTOR_SIZE>> m_overlay;
+        uint64_t m_writeGeneration = 0;
+
+        // Write-back. Every batch goes into the journal before the image, so a crash halfway through is
+        // finished by replaying the journal the next time the image is opened
+        std::string m_journalPath;
+        std::thread m_flushThread;
+        mutable std::mutex m_mutex;
+        mutable std::condition_variable m_flushCondition; // Wakes the flush thread
+        mutable std::condition_variable m_syncCondition; // Wakes sync callers
+        std::set<size_t> m_dirty;
+        uint64_t m_flushedGeneration = 0;
+        bool m_flushFailed = false;
+        mutable bool m_syncRequested = false;
+        bool m_stopping = false;
+
+        std::thread m_preloadThread;
+    };
+}
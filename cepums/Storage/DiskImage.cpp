@@ -0,0 +1,145 @@
+#include "cepumspch.h"
+#include "DiskImage.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Cepums {
+
+    DiskImage::~DiskImage()
+    {
+        close();
+    }
+
+#ifdef _WIN32
+    bool DiskImage::open(const std::string& path, const DiskGeometry& geometry)
+    {
+        close();
+
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            DC_CORE_ERROR("[DiskImage]: Can't open {0}", path);
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+        {
+            DC_CORE_ERROR("[DiskImage]: {0} is empty", path);
+            CloseHandle(file);
+            return false;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!data)
+        {
+            DC_CORE_ERROR("[DiskImage]: Can't map {0}", path);
+            if (mapping)
+                CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = (uint8_t*)data;
+        m_size = (size_t)size.QuadPart;
+        m_path = path;
+        m_geometry = geometry;
+        return true;
+    }
+
+    void DiskImage::close()
+    {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+
+        m_data = nullptr;
+        m_mapping = nullptr;
+        m_file = nullptr;
+        m_size = 0;
+    }
+#else
+    bool DiskImage::open(const std::string& path, const DiskGeometry& geometry)
+    {
+        close();
+
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            DC_CORE_ERROR("[DiskImage]: Can't open {0}", path);
+            return false;
+        }
+
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size == 0)
+        {
+            DC_CORE_ERROR("[DiskImage]: {0} is empty", path);
+            ::close(file);
+            return false;
+        }
+
+        void* data = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+        if (data == MAP_FAILED)
+        {
+            DC_CORE_ERROR("[DiskImage]: Can't map {0}", path);
+            ::close(file);
+            return false;
+        }
+
+        m_file = file;
+        m_data = (uint8_t*)data;
+        m_size = (size_t)status.st_size;
+        m_path = path;
+        m_geometry = geometry;
+        return true;
+    }
+
+    void DiskImage::close()
+    {
+        if (m_data)
+            munmap(m_data, m_size);
+        if (m_file >= 0)
+            ::close(m_file);
+
+        m_data = nullptr;
+        m_file = -1;
+        m_size = 0;
+    }
+#endif
+
+    size_t DiskImage::toLBA(unsigned int cylinder, unsigned int head, unsigned int sector) const
+    {
+        if (cylinder >= m_geometry.cylinders || head >= m_geometry.heads || sector == 0 || sector > m_geometry.sectorsPerTrack)
+            return INVALID_LBA;
+        return ((size_t)cylinder * m_geometry.heads + head) * m_geometry.sectorsPerTrack + sector - 1;
+    }
+
+    void DiskImage::prefetch() const
+    {
+        volatile uint8_t sink = 0;
+        for (size_t offset = 0; offset < m_size; offset += 4096)
+            sink = sink + m_data[offset];
+    }
+
+    size_t DiskImage::getAvailableSectors(size_t lba, size_t count) const
+    {
+        size_t inFile = m_size / SECTOR_SIZE;
+        if (lba >= inFile)
+            return 0;
+        return std::min(count, inFile - lba);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define SECTOR_SIZE 512
+#define INVALID_LBA SIZE_MAX
+
+namespace Cepums {
+
+    struct DiskGeometry
+    {
+        unsigned int cylinders = 80;
+        unsigned int heads = 2;
+        unsigned int sectorsPerTrack = 18;
+
+        size_t getSectorCount() const { return (size_t)cylinders * heads * sectorsPerTrack; }
+        size_t getSize() const { return getSectorCount() * SECTOR_SIZE; }
+    };
+
+    // A disk image file mapped read-only into memory, writes go to the DiskBackend's overlay. Nothing is read up front,
+    // sectors come straight out of the page cache when they're copied into the guest
+    class DiskImage
+    {
+    public:
+        DiskImage() = default;
+        ~DiskImage();
+
+        DiskImage(const DiskImage&) = delete;
+        DiskImage& operator=(const DiskImage&) = delete;
+
+        bool open(const std::string& path, const DiskGeometry& geometry);
+        void close();
+
+        bool isOpen() const { return m_data != nullptr; }
+        const std::string& getPath() const { return m_path; }
+        const DiskGeometry& getGeometry() const { return m_geometry; }
+
+        // Sectors are numbered from 1 like on the disk. Returns INVALID_LBA outside of the geometry
+        size_t toLBA(unsigned int cylinder, unsigned int head, unsigned int sector) const;
+
+        // How many of the count sectors starting at lba are actually in the file (it can be shorter than the geometry)
+        size_t getAvailableSectors(size_t lba, size_t count) const;
+
+        // The mapped sectors, check getAvailableSectors first
+        const uint8_t* getSectors(size_t lba) const { return m_data + lba * SECTOR_SIZE; }
+
+        // Touches every page of the mapping, so the file is in memory before the guest asks for it
+        void prefetch() const;
+    private:
+        std::string m_path;
+        DiskGeometry m_geometry;
+
+        uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#else
+        int m_file = -1;
+#endif
+    };
+}
@@ -0,0 +1,137 @@
+#include "cepumspch.h"
+#include "DiskServices.h"
+
+#include "Hardware/FloppyDiskController.h"
+#include "Processor/Processor.h"
+
+// BIOS data area
+#define BDA_SEGMENT 0x40
+#define BDA_EQUIPMENT 0x10
+#define BDA_FLOPPY_STATUS 0x41
+#define BDA_HARD_DISK_STATUS 0x74
+
+// INT 13h status codes
+#define STATUS_OK 0x00
+#define STATUS_INVALID_COMMAND 0x01
+#define STATUS_SECTOR_NOT_FOUND 0x04
+#define STATUS_DMA_BOUNDARY 0x09
+#define STATUS_TIMEOUT 0x80
+
+namespace Cepums {
+
+    DiskServices::DiskServices(DiskBackend* floppyDisks, DiskBackend& hardDisk, MemoryManager& memoryManager)
+        : m_floppyDisks(floppyDisks)
+        , m_hardDisk(hardDisk)
+        , m_memoryManager(memoryManager)
+    {
+    }
+
+    bool DiskServices::handleInterrupt(Processor& cpu)
+    {
+        // The floppy drives, and the XT-IDE disk when there is one
+        uint8_t function = cpu.AH();
+        uint8_t drive = cpu.DL();
+        bool hardDisk = IS_BIT_SET(drive, 7);
+        DiskBackend* disk = nullptr;
+        if (drive < FLOPPY_DRIVE_COUNT)
+            disk = &m_floppyDisks[drive];
+        else if (drive == 0x80 && m_hardDisk.isOpen())
+            disk = &m_hardDisk;
+        else
+            return false;
+
+        uint8_t status;
+        switch (function)
+        {
+        case 0x00: // Reset
+            status = STATUS_OK;
+            break;
+        case 0x02: // Read sectors
+        case 0x03: // Write sectors
+        case 0x04: // Verify sectors
+            status = transfer(cpu, *disk, function, hardDisk);
+            break;
+        case 0x08: // Get drive parameters
+            status = getParameters(cpu, *disk, hardDisk);
+            break;
+        default:
+            return false;
+        }
+
+        DC_CORE_TRACE("[DiskServices]: Function 0x{0:X} on drive 0x{1:X} returned 0x{2:X}", function, drive, status);
+        cpu.AH(status);
+        if (status == STATUS_OK)
+            cpu.ins$CLC();
+        else
+            cpu.ins$STC();
+        m_memoryManager.writeByte(BDA_SEGMENT, hardDisk ? BDA_HARD_DISK_STATUS : BDA_FLOPPY_STATUS, status);
+        return true;
+    }
+
+    uint8_t DiskServices::transfer(Processor& cpu, DiskBackend& disk, uint8_t function, bool hardDisk)
+    {
+        unsigned int count = cpu.AL();
+        cpu.AL(0);
+        if (!disk.isOpen())
+            return STATUS_TIMEOUT;
+        if (count == 0)
+            return STATUS_INVALID_COMMAND;
+
+        // Hard disks keep the top two cylinder bits in CL
+        unsigned int cylinder = cpu.CH() | (hardDisk ? (unsigned int)(cpu.CL() & 0xC0) << 2 : 0);
+        size_t lba = disk.toLBA(cylinder, cpu.DH(), cpu.CL() & 0x3F);
+        if (lba == INVALID_LBA || lba + count > disk.getGeometry().getSectorCount())
+            return STATUS_SECTOR_NOT_FOUND;
+
+        // The floppy BIOS refuses transfers that would wrap around a 64K DMA page
+        uint32_t address = MemoryManager::addresstoPhysical(cpu.ES(), cpu.BX());
+        size_t length = (size_t)count * SECTOR_SIZE;
+        if (!hardDisk && function != 0x04 && (address & 0xFFFF) + length > 0x10000)
+            return STATUS_DMA_BOUNDARY;
+
+        std::vector<uint8_t> buffer(length);
+        if (function == 0x02)
+        {
+            disk.readSectors(lba, count, buffer.data());
+            m_memoryManager.writeBlock(address, buffer.data(), length);
+        }
+        else if (function == 0x03)
+        {
+            m_memoryManager.readBlock(address, buffer.data(), length);
+            disk.writeSectors(lba, count, buffer.data());
+        }
+
+        cpu.AL(count);
+        return STATUS_OK;
+    }
+
+    uint8_t DiskServices::getParameters(Processor& cpu, DiskBackend& disk, bool hardDisk)
+    {
+        if (!disk.isOpen())
+            return STATUS_TIMEOUT;
+
+        auto& geometry = disk.getGeometry();
+        unsigned int lastCylinder = std::min(geometry.cylinders, 1024u) - 1;
+        cpu.AL(0);
+        cpu.CH(lastCylinder & 0xFF);
+        cpu.CL((geometry.sectorsPerTrack & 0x3F) | ((lastCylinder >> 2) & 0xC0));
+        cpu.DH(geometry.heads - 1);
+
+        if (hardDisk)
+        {
+            cpu.DL(1);
+            return STATUS_OK;
+        }
+
+        // Drive type, the number of drives from the equipment word and the diskette parameter table behind INT 1Eh
+        // INT 13h numbers the drive types like the CMOS, except for 2.88M drives
+        uint8_t type = FloppyDiskController::getCMOSDriveType(geometry);
+        cpu.BX() = type == 5 ? 6 : type;
+
+        uint16_t equipment = m_memoryManager.readWord(BDA_SEGMENT, BDA_EQUIPMENT);
+        cpu.DL(IS_BIT_SET(equipment, 0) ? ((equipment >> 6) & 0x3) + 1 : 0);
+        cpu.DI() = m_memoryManager.readWord(0, 0x1E * 4);
+        cpu.ES() = m_memoryManager.readWord(0, 0x1E * 4 + 2);
+        return STATUS_OK;
+    }
+}
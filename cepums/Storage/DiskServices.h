@@ -0,0 +1,29 @@
+#pragma once
+
+#include "DiskBackend.h"
+#include "MemoryManager.h"
+
+namespace Cepums {
+
+    class Processor;
+
+    // High-level emulation of the BIOS INT 13h disk services: reset, read, write, verify and get parameters
+    // are run against the disk images directly, with the data copied to and from ES:BX in one go
+    class DiskServices
+    {
+    public:
+        // floppyDisks has one backend for each floppy drive
+        DiskServices(DiskBackend* floppyDisks, DiskBackend& hardDisk, MemoryManager& memoryManager);
+
+        // Services the call in the processor's registers and sets AH and CF like the BIOS would. Returns false
+        // for functions and drives that are left to the BIOS
+        bool handleInterrupt(Processor& cpu);
+    private:
+        uint8_t transfer(Processor& cpu, DiskBackend& disk, uint8_t function, bool hardDisk);
+        uint8_t getParameters(Processor& cpu, DiskBackend& disk, bool hardDisk);
+    private:
+        DiskBackend* m_floppyDisks;
+        DiskBackend& m_hardDisk;
+        MemoryManager& m_memoryManager;
+    };
+}
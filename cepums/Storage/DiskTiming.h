@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Clock.h"
+
+namespace Cepums {
+
+    enum class DiskTiming
+    {
+        Instant, // Operations finish right away
+        Realistic // Seeks, head settling and rotation take as long as on a real drive
+    };
+
+    // A spinning disk, which has been turning since the machine started. Sector 1 of every track comes
+    // right after the index hole and the sectors are spread evenly around the track
+    struct DiskRotation
+    {
+        uint64_t revolution; // Master clock ticks per revolution
+        unsigned int sectorsPerTrack;
+
+        uint64_t getSectorTime() const { return revolution / sectorsPerTrack; }
+
+        uint64_t getTimeUntilIndex(uint64_t now) const { return revolution - now % revolution; }
+
+        // How long until the start of the sector (numbered from 1) comes under the head
+        uint64_t getTimeUntilSector(uint64_t now, unsigned int sector) const
+        {
+            uint64_t start = (uint64_t)(sector - 1) % sectorsPerTrack * getSectorTime();
+            return (start + revolution - now % revolution) % revolution;
+        }
+    };
+
+    inline uint64_t revolutionsPerMinuteToMasterTicks(uint64_t rpm)
+    {
+        return microsecondsToMasterTicks(60000000 / rpm);
+    }
+}
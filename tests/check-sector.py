@@ -0,0 +1,18 @@
+#!/usr/bin/env python3
+# Fails unless every word of a sector in an image is the given value.
+# Usage: check-sector.py <image> <lba> <word>
+
+import struct
+import sys
+
+if len(sys.argv) != 4:
+    sys.exit("Usage: check-sector.py <image> <lba> <word>")
+
+lba = int(sys.argv[2], 0)
+expected = int(sys.argv[3], 0)
+with open(sys.argv[1], "rb") as image:
+    image.seek(lba * 512)
+    words = struct.unpack("<256H", image.read(512))
+
+if any(word != expected for word in words):
+    sys.exit(f"{sys.argv[1]}: sector {lba} holds {words[0]:04X}, expected {expected:04X}")
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+# Fails unless a stretch of a 16-bit mono WAV file is a tone within 5% of the given frequency, or silence for 0 Hz.
+# Usage: check-tone.py <wav> <from seconds> <to seconds> <Hz>
+
+import struct
+import sys
+import wave
+
+if len(sys.argv) != 5:
+    sys.exit("Usage: check-tone.py <wav> <from seconds> <to seconds> <Hz>")
+
+start, end, frequency = float(sys.argv[2]), float(sys.argv[3]), float(sys.argv[4])
+with wave.open(sys.argv[1], "rb") as recording:
+    rate = recording.getframerate()
+    recording.setpos(int(start * rate))
+    count = int((end - start) * rate)
+    data = recording.readframes(count)
+
+if len(data) != count * 2:
+    sys.exit(f"{sys.argv[1]}: ends before {end} s")
+samples = struct.unpack(f"<{count}h", data)
+peak = max(abs(sample) for sample in samples)
+
+if frequency == 0:
+    if peak > 327:
+        sys.exit(f"{sys.argv[1]}: expected silence from {start} s to {end} s, the peak is {peak}")
+    sys.exit(0)
+
+# Two zero crossings per period
+crossings = sum(1 for previous, sample in zip(samples, samples[1:]) if (previous < 0) != (sample < 0))
+measured = crossings / 2 / (end - start)
+if peak < 3277 or abs(measured - frequency) > frequency * 0.05:
+    sys.exit(f"{sys.argv[1]}: expected {frequency} Hz from {start} s to {end} s, got {measured:.0f} Hz with a peak of {peak}")
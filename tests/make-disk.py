@@ -0,0 +1,14 @@
+#!/usr/bin/env python3
+# Writes a disk image for the test ROMs where every word of a sector holds its LBA, so a ROM can tell which sector it got.
+# Usage: make-disk.py <file> <size in KB>
+
+import struct
+import sys
+
+if len(sys.argv) != 3:
+    sys.exit("Usage: make-disk.py <file> <size in KB>")
+
+sectors = int(sys.argv[2]) * 1024 // 512
+with open(sys.argv[1], "wb") as image:
+    for lba in range(sectors):
+        image.write(struct.pack("<H", lba & 0xFFFF) * 256)
@@ -0,0 +1,25 @@
+#!/usr/bin/env python3
+# Leaves a write-back journal next to an image, like a run that crashed between the journal and the image,
+# for one sector where every word is the given value. A torn journal is cut short like a crash while writing it.
+# Usage: make-journal.py <image> <lba> <word> [torn]
+
+import struct
+import sys
+
+if len(sys.argv) not in (4, 5):
+    sys.exit("Usage: make-journal.py <image> <lba> <word> [torn]")
+
+lba = int(sys.argv[2], 0)
+entries = struct.pack("<Q", lba) + struct.pack("<H", int(sys.argv[3], 0)) * 256
+
+# FNV-1a over the entries
+checksum = 0xCBF29CE484222325
+for byte in entries:
+    checksum = ((checksum ^ byte) * 0x100000001B3) & 0xFFFFFFFFFFFFFFFF
+
+journal = struct.pack("<IIQ", 0x4C4E4A43, 1, checksum) + entries
+if len(sys.argv) == 5:
+    journal = journal[:len(journal) // 2]
+
+with open(sys.argv[1] + ".journal", "wb") as file:
+    file.write(journal)
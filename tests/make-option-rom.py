@@ -0,0 +1,15 @@
+#!/usr/bin/env python3
+# Writes a 2K option ROM with a valid checksum. Its initialization sets the byte at DS:0520h to 1 and returns.
+# Usage: make-option-rom.py <file>
+
+import sys
+
+if len(sys.argv) != 2:
+    sys.exit("Usage: make-option-rom.py <file>")
+
+# Signature, size in 512 byte blocks, then movb $1, (0x520) and lret
+rom = bytearray([0x55, 0xAA, 4, 0xC6, 0x06, 0x20, 0x05, 0x01, 0xCB])
+rom += bytes(2048 - len(rom))
+rom[-1] = -sum(rom) & 0xFF
+with open(sys.argv[1], "wb") as image:
+    image.write(rom)
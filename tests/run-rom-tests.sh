@@ -0,0 +1,66 @@
+#!/usr/bin/env bash
+# Runs every test ROM in tests/roms on a headless build of the emulator.
+# A ROM reports through POST codes on port 80h and ends with AAh when its checks pass or EEh when one fails.
+# Lines in a ROM's source set up its run:
+#   # run-for: <seconds>  host seconds to run it for (default 10)
+#   # args: <options>     more emulator options
+#   # setup: <command>    run in the ROM's directory before the emulator, $TESTS is this directory
+#   # check: <command>    run there afterwards, the ROM fails if it does
+# Usage: tests/run-rom-tests.sh <path to the cepums binary>
+# Needs GNU as and objcopy that can target 32-bit x86, and python3 for the disk images and checks.
+
+if [ $# -ne 1 ] || [ ! -x "$1" ]; then
+    echo "Usage: $0 <path to the cepums binary>" >&2
+    exit 2
+fi
+
+emulator=$(realpath "$1")
+export TESTS=$(dirname "$(realpath "$0")")
+roms=$TESTS/roms
+failed=0
+
+# Runs every "# <name>:" command of a ROM in the current directory
+runCommands() {
+    while IFS= read -r command; do
+        bash -c "$command" || return 1
+    done < <(sed -n "s/^# $2: *//p" "$1")
+}
+
+for source in "$roms"/*.S; do
+    name=$(basename "$source" .S)
+    work=$(mktemp -d)
+    seconds=$(sed -n 's/^# run-for: *\([0-9]*\)/\1/p' "$source")
+    args=$(sed -n 's/^# args: *//p' "$source")
+
+    if ! as --32 -I "$roms" "$source" -o "$work/rom.o" || ! objcopy -O binary -j .text "$work/rom.o" "$work/bios.bin"; then
+        echo "FAIL $name: doesn't assemble"
+        failed=1
+        rm -rf "$work"
+        continue
+    fi
+
+    if ! (cd "$work" && runCommands "$source" setup); then
+        echo "FAIL $name: setup failed"
+        failed=1
+        rm -rf "$work"
+        continue
+    fi
+
+    codes=$(cd "$work" && "$emulator" --headless --run-for "${seconds:-10}" $args 2>&1 | sed -n 's/.*POST\[\([0-9]*\)\].*/\1/p' | tr '\n' ' ')
+
+    case " $codes" in
+        *" 238 "*) echo "FAIL $name: $codes"; failed=1 ;;
+        *" 170 ")
+            if (cd "$work" && runCommands "$source" check); then
+                echo "PASS $name: $codes"
+            else
+                echo "FAIL $name: check failed: $codes"
+                failed=1
+            fi
+            ;;
+        *) echo "FAIL $name: didn't finish: $codes"; failed=1 ;;
+    esac
+    rm -rf "$work"
+done
+
+exit $failed